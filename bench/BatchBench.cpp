@@ -0,0 +1,126 @@
+#include "logger.h"
+#include "FileManager.h"
+#include "PakReader.h"
+#include "ZipWriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+
+//Times FileManager parsing a batch of synthetic varlist diffs, each with its own target, with 1, 2, 4 and so on up to one parse worker per
+//hardware thread or to max workers. Every batch is committed into its own copy of the archives and read back, and fails if it differs
+//from the one worker batch. Usage: BatchBench [diffs] [entries per target] [max workers]. The files are written to the working directory
+//and removed afterwards.
+namespace {
+
+	const path ROOT{ "BatchBench_files" };	//Not "BatchBench", which is this executable when run from the build directory
+
+	[[nodiscard]] double Milliseconds(Clock::time_point since) noexcept { return std::chrono::duration<double, std::milli>(Clock::now() - since).count(); }
+
+	//Writes count diffs to ROOT/diffs and their targets, spread over four archives, to ROOT/paks
+	[[nodiscard]] bool MakeBatch(szt count, szt entries) {
+		constexpr szt ARCHIVES{ 4u };
+		std::error_code ec{};
+		create_directories(ROOT / "diffs", ec);
+		create_directories(ROOT / "paks", ec);
+		vector<vector<std::pair<string, string>>> paks(ARCHIVES);
+		for (szt i{ 0u }; i < count; ++i) {
+			const string name{ "scripts/d" + to_string(i) + "/varlist.scr" };
+			string target{}, diff{ name + "\n" };
+			for (szt e{ 0u }; e < entries; ++e) {
+				target += "VarInt(\"v" + to_string(e) + "\", " + to_string(i) + ")\n";
+				if (e % 10u == 0u) {
+					diff += "VarInt(\"v" + to_string(e) + "\", " + to_string(i) + ") [rename] VarInt(\"w" + to_string(e) + "\", 1)\n";
+				}
+			}
+			paks[i % ARCHIVES].emplace_back(name, std::move(target));
+			std::ofstream ofs{ ROOT / "diffs" / ("diff" + to_string(i) + ".txt"), std::ios::binary | std::ios::trunc };
+			if (!ofs.write(diff.data(), static_cast<std::streamsize>(diff.size()))) {
+				return false;
+			}
+		}
+		for (szt i{ 0u }; i < ARCHIVES; ++i) {
+			if (!ZipWriter::Write(ROOT / "paks" / ("data" + to_string(i) + ".pak"), paks[i], ZipWriter::DEFLATED)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//Every entry of every archive in dir, by name
+	[[nodiscard]] bool ReadBack(const path& dir, map<string, string>& out) {
+		for (const auto& file : directory_iterator{ dir }) {
+			PakReader reader{};
+			if (!reader.Open(file.path())) {
+				return false;
+			}
+			for (szt i{ 0u }; i < reader.Entries().size(); ++i) {
+				if (!reader.Read(i, out[reader.Entries()[i].name])) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	//Parses and commits the batch into a copy of the archives with workers parse workers
+	[[nodiscard]] bool RunBatch(szt workers, map<string, string>& committed) {
+		const path paks{ ROOT / ("paks" + to_string(workers)) };
+		std::error_code ec{};
+		std::filesystem::copy(ROOT / "paks", paks, copy_options::recursive | copy_options::overwrite_existing, ec);
+		FileManager file_manager{};
+		file_manager.SetParseWorkers(workers);
+		if (ec || !file_manager.SetDiffPath((ROOT / "diffs").string()) || !file_manager.SetTargetPath(paks.string())) {
+			std::cout << "Batch: failed to set up " << workers << " workers, see the log\n";
+			return false;
+		}
+		const auto start{ Clock::now() };
+		if (!file_manager.ParseWithoutCommit()) {
+			std::cout << "Batch: parse with " << workers << " workers failed, see the log\n";
+			return false;
+		}
+		const double parsed{ Milliseconds(start) };
+		if (!file_manager.Commit() || !ReadBack(paks, committed)) {
+			std::cout << "Batch: commit with " << workers << " workers failed, see the log\n";
+			return false;
+		}
+		remove_all(paks, ec);
+		std::cout << "Batch: parsed with " << workers << (workers == 1u ? " worker in " : " workers in ") << parsed << " ms\n";
+		return true;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	logger.Init();
+	const szt count{ argc > 1 ? static_cast<szt>(std::stoull(argv[1])) : 200u };
+	const szt entries{ argc > 2 ? static_cast<szt>(std::stoull(argv[2])) : 4000u };
+	const szt hardware{ std::max(std::thread::hardware_concurrency(), 1u) };
+	const szt most{ argc > 3 ? static_cast<szt>(std::stoull(argv[3])) : hardware };
+	bool same{ MakeBatch(count, entries) };
+	if (!same) {
+		std::cout << "Batch: failed to write the diffs and archives\n";
+	}
+	std::cout << "Batch: " << count << " diffs of " << entries << " entries each, " << hardware << " hardware threads\n";
+
+	map<string, string> serial{};
+	same = same && RunBatch(1u, serial);
+	for (szt workers{ 2u }; same && workers <= most; workers = (workers < most ? std::min(workers * 2u, most) : workers + 1u)) {
+		map<string, string> parallel{};
+		same = RunBatch(workers, parallel);
+		if (same && parallel != serial) {
+			std::cout << "Batch: the commit with " << workers << " workers differs from the one with 1\n";
+			same = false;
+		}
+	}
+	std::error_code ec{};
+	remove_all(ROOT, ec);
+	logger.Close();
+	return same ? 0 : 1;
+}
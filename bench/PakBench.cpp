@@ -0,0 +1,179 @@
+#include "logger.h"
+#include "PakReader.h"
+#include "ZipWriter.h"
+
+#include <libzippp.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+using Clock = std::chrono::steady_clock;
+using std::filesystem::path;
+
+
+//Times reading every entry of a synthetic archive with PakReader and with libzippp, once stored and once deflated, and committing large
+//outputs through temp files and from memory. Usage: PakBench [entries] [outputs]. The archives are written to the working directory and
+//removed afterwards.
+namespace {
+
+	[[nodiscard]] double Milliseconds(Clock::time_point since) noexcept { return std::chrono::duration<double, std::milli>(Clock::now() - since).count(); }
+
+	//Script-like text of at least size bytes
+	[[nodiscard]] string MakeText(szt size, szt seed) {
+		string text{};
+		for (szt line{ 0u }; text.size() < size; ++line) {
+			text += "\tVarInt(\"v" + to_string(line) + "\", " + to_string(seed * line) + ");\n";
+		}
+		return text;
+	}
+
+	//Entries between 4 and 64 KiB, so they look like the targets the patcher reads
+	[[nodiscard]] vector<std::pair<string, string>> MakeEntries(szt count) {
+		vector<std::pair<string, string>> entries(count);
+		for (szt i{ 0u }; i < count; ++i) {
+			entries[i].first = "scripts/d" + to_string(i) + "/test.scr";
+			entries[i].second = MakeText(4096u + (i * 7919u) % 61440u, i);
+		}
+		return entries;
+	}
+
+	//Reads file back with PakReader and checks that every one of outputs is in it
+	[[nodiscard]] bool Committed(const path& file, const vector<std::pair<string, string>>& outputs, string_view label) {
+		PakReader reader{};
+		if (!reader.Open(file)) {
+			std::cout << label << ": the committed archive doesn't open, see the log\n";
+			return false;
+		}
+		std::unordered_map<string, szt> positions{};
+		for (szt i{ 0u }; i < reader.Entries().size(); ++i) {
+			positions.emplace(reader.Entries()[i].name, i);
+		}
+		string text{};
+		for (const auto& [name, output] : outputs) {
+			const auto it{ positions.find(name) };
+			if (it == positions.cend() || !reader.Read(it->second, text) || text != output) {
+				std::cout << label << ": <" << name << "> wasn't committed as written\n";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//Commits count outputs of about 1 MiB each into copies of one archive. Once the way Commit() used to, with a temp file per output
+	//given to addFile(), and once with addData() straight from memory. Both timings include close(), which is when libzippp reads the data.
+	[[nodiscard]] bool CompareCommit(szt count) {
+		constexpr szt OUTPUT_SIZE{ 1024u * 1024u };
+		vector<std::pair<string, string>> originals(count), outputs(count);
+		szt bytes{ 0u };
+		for (szt i{ 0u }; i < count; ++i) {
+			originals[i] = { "scripts/c" + to_string(i) + "/test.scr", MakeText(4096u, i) };
+			outputs[i] = { originals[i].first, MakeText(OUTPUT_SIZE, i + 1u) };
+			bytes += outputs[i].second.size();
+		}
+		const path temp_pak{ "PakBench_commit_temp.pak" }, data_pak{ "PakBench_commit_data.pak" };
+		if (!ZipWriter::Write(temp_pak, originals, ZipWriter::DEFLATED) || !ZipWriter::Write(data_pak, originals, ZipWriter::DEFLATED)) {
+			std::cout << "Commit: failed to write the archives\n";
+			return false;
+		}
+
+		auto start{ Clock::now() };
+		libzippp::ZipArchive through_files{ temp_pak.string() };
+		vector<path> temps{};
+		bool added{ through_files.open(libzippp::ZipArchive::Write) };
+		for (szt i{ 0u }; added && i < count; ++i) {
+			temps.emplace_back("PakBench_" + to_string(i) + ".temp");
+			std::ofstream ofs{ temps.back(), std::ios::binary | std::ios::trunc };
+			added = ofs.write(outputs[i].second.data(), static_cast<std::streamsize>(outputs[i].second.size())).good();
+			ofs.close();
+			added = added && through_files.addFile(outputs[i].first, temps.back().string());
+		}
+		added = through_files.close() == libzippp::LIBZIPPP_OK && added;
+		std::error_code ec{};
+		for (const auto& temp : temps) {
+			std::filesystem::remove(temp, ec);
+		}
+		const double files{ Milliseconds(start) };
+
+		start = Clock::now();
+		libzippp::ZipArchive from_memory{ data_pak.string() };
+		added = from_memory.open(libzippp::ZipArchive::Write) && added;
+		for (szt i{ 0u }; added && i < count; ++i) {
+			added = from_memory.addData(outputs[i].first, outputs[i].second.data(), outputs[i].second.size());
+		}
+		added = from_memory.close() == libzippp::LIBZIPPP_OK && added;
+		const double memory{ Milliseconds(start) };
+
+		const bool same{ added && Committed(temp_pak, outputs, "Commit through temp files") && Committed(data_pak, outputs, "Commit from memory") };
+		std::filesystem::remove(temp_pak, ec);
+		std::filesystem::remove(data_pak, ec);
+		if (!added) {
+			std::cout << "Commit: libzippp failed to add the outputs\n";
+			return false;
+		}
+		std::cout << "Commit: " << count << " outputs (" << bytes << " bytes) in " << files << " ms through temp files, " << memory << " ms from memory\n";
+		return same;
+	}
+
+	//Reads every entry with both libraries and checks them against what was written
+	[[nodiscard]] bool Compare(const path& file, const vector<std::pair<string, string>>& entries, string_view label) {
+		szt bytes{ 0u };
+		auto start{ Clock::now() };
+		PakReader reader{};
+		if (!reader.Open(file) || reader.Entries().size() != entries.size()) {
+			std::cout << label << ": PakReader failed to open the archive, see the log\n";
+			return false;
+		}
+		string text{};
+		for (szt i{ 0u }; i < entries.size(); ++i) {
+			if (!reader.Read(i, text) || text != entries[i].second) {
+				std::cout << label << ": PakReader misread <" << entries[i].first << ">\n";
+				return false;
+			}
+			bytes += text.size();
+		}
+		reader.Close();
+		const double ours{ Milliseconds(start) };
+
+		start = Clock::now();
+		libzippp::ZipArchive archive{ file.string() };
+		if (!archive.open(libzippp::ZipArchive::ReadOnly)) {
+			std::cout << label << ": libzippp failed to open the archive\n";
+			return false;
+		}
+		for (const auto& entry : archive.getEntries()) {
+			if (entry.readAsText() != entries[entry.getIndex()].second) {
+				std::cout << label << ": libzippp misread <" << entry.getName() << ">\n";
+				return false;
+			}
+		}
+		archive.close();
+		std::cout << label << ": read " << entries.size() << " entries (" << bytes << " bytes) in " << ours << " ms with PakReader, " << Milliseconds(start) << " ms with libzippp\n";
+		return true;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	logger.Init();
+	const szt count{ argc > 1 ? static_cast<szt>(std::stoull(argv[1])) : 2000u };
+	const szt outputs{ argc > 2 ? static_cast<szt>(std::stoull(argv[2])) : 40u };
+	const vector<std::pair<string, string>> entries{ MakeEntries(count) };
+	bool same{ true };
+	for (const uint32 method : { ZipWriter::STORED, ZipWriter::DEFLATED }) {
+		const path file{ method == ZipWriter::STORED ? "PakBench_stored.pak" : "PakBench_deflated.pak" };
+		if (!ZipWriter::Write(file, entries, method)) {
+			std::cout << "Failed to write <" << file.string() << ">\n";
+			same = false;
+			continue;
+		}
+		same = Compare(file, entries, method == ZipWriter::STORED ? "Stored" : "Deflated") && same;
+		std::error_code ec{};
+		std::filesystem::remove(file, ec);
+	}
+	same = CompareCommit(outputs) && same;
+	logger.Close();
+	return same ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+#include "logger.h"
+#include "AssosciativeCache.h"
+#include "StringParser.h"
+
+#include <chrono>
+#include <iostream>
+
+using Clock = std::chrono::steady_clock;
+
+
+//Times the string cache, a whole parse of a synthetic varlist, loading its diff as text or compiled and merging pregenerated trees, and
+//reports how well a node store deduplicates a synthetic set of scripts. Usage: ParserBench [entries] [scripts]
+namespace {
+
+	[[nodiscard]] double Milliseconds(Clock::time_point since) noexcept { return std::chrono::duration<double, std::milli>(Clock::now() - since).count(); }
+
+	//Interns count distinct strings, then looks each one up by ID the way serialization does
+	void BenchCache(szt count) {
+		AssosciativeCache<string, uint32> cache{};
+		vector<uint32> ids{};
+		ids.reserve(count);
+		const auto start{ Clock::now() };
+		for (szt i{ 0u }; i < count; ++i) {
+			ids.push_back(cache.FindOrAdd("VarInt(\"v" + to_string(i) + "\", 0)"));
+		}
+		const double interned{ Milliseconds(start) };
+		szt bytes{ 0u };
+		const auto lookup{ Clock::now() };
+		for (const uint32 id : ids) {
+			bytes += cache.Find(id).size();
+		}
+		std::cout << "Cache: interned " << count << " strings in " << interned << " ms, found them by ID in " << Milliseconds(lookup) << " ms (" << bytes << " bytes)\n";
+	}
+
+	//Parses target with diff, with the top level merge on the calling thread or on the thread pool
+	[[nodiscard]] bool ParseVarlist(const string& target, const string& diff, bool parallel, string& out) {
+		StringParser::Parser parser{};
+		parser.SetParallelMerge(parallel);
+		const auto start{ Clock::now() };
+		if (!parser.SetDiff(diff) || !parser.SetTarget(target) || !parser.Parse(out)) {
+			std::cout << "Varlist: parse failed, see the log\n";
+			return false;
+		}
+		std::cout << "Varlist: parsed with " << (parallel ? "parallel" : "serial") << " merge in " << Milliseconds(start) << " ms (" << out.size() << " bytes out)\n";
+		return true;
+	}
+
+	//A varlist of count entries and a diff that renames every tenth one. Fails if the parallel merge changes the output.
+	[[nodiscard]] bool BenchVarlist(szt count) {
+		string target{}, diff{ "scripts/varlist.scr\n" };
+		for (szt i{ 0u }; i < count; ++i) {
+			target += "VarInt(\"v" + to_string(i) + "\", 0)\n";
+			if (i % 10u == 0u) {
+				diff += "VarInt(\"v" + to_string(i) + "\", 0) [rename] VarInt(\"v" + to_string(i) + "\", 1)\n";
+			}
+		}
+		string serial{}, parallel{};
+		if (!ParseVarlist(target, diff, false, serial) || !ParseVarlist(target, diff, true, parallel)) {
+			return false;
+		}
+		if (serial != parallel) {
+			std::cout << "Varlist: the parallel merge output differs from the serial one\n";
+			return false;
+		}
+		return true;
+	}
+
+	//Loads the same varlist diff as text and as a patch program. Fails if the two parse differently.
+	[[nodiscard]] bool BenchCompiledDiff(szt count) {
+		string target{}, diff{ "scripts/varlist.scr\n" };
+		for (szt i{ 0u }; i < count; ++i) {
+			target += "VarInt(\"v" + to_string(i) + "\", 0)\n";
+			diff += "VarInt(\"v" + to_string(i) + "\", 0) [rename] VarInt(\"v" + to_string(i) + "\", 1)\n";
+		}
+		StringParser::Parser parser{};
+		string program{}, from_text{}, from_program{};
+		if (!parser.SetDiff(diff) || !parser.CompileDiff(program)) {
+			std::cout << "Diff: compile failed, see the log\n";
+			return false;
+		}
+
+		auto start{ Clock::now() };
+		if (!parser.SetDiff(diff)) {
+			std::cout << "Diff: text load failed, see the log\n";
+			return false;
+		}
+		const double text{ Milliseconds(start) };
+		if (!parser.SetTarget(target) || !parser.Parse(from_text)) {
+			std::cout << "Diff: parse with the text diff failed, see the log\n";
+			return false;
+		}
+
+		start = Clock::now();
+		if (!parser.SetDiffProgram(program)) {
+			std::cout << "Diff: program load failed, see the log\n";
+			return false;
+		}
+		const double compiled{ Milliseconds(start) };
+		if (!parser.SetTarget(target) || !parser.Parse(from_program)) {
+			std::cout << "Diff: parse with the compiled diff failed, see the log\n";
+			return false;
+		}
+
+		std::cout << "Diff: loaded " << count << " operations as text (" << diff.size() << " bytes) in " << text << " ms, compiled (" << program.size() << " bytes) in " << compiled << " ms\n";
+		if (from_text != from_program) {
+			std::cout << "Diff: the compiled diff parses differently from the text one\n";
+			return false;
+		}
+		return true;
+	}
+
+	//Merges one generated diff into one generated target repeatedly, as a batch would reuse both. Fails if it differs from Parse().
+	[[nodiscard]] bool BenchMerge(szt count) {
+		constexpr szt MERGES{ 10u };
+		string target{}, diff{ "scripts/varlist.scr\n" };
+		for (szt i{ 0u }; i < count; ++i) {
+			target += "VarInt(\"v" + to_string(i) + "\", 0)\n";
+			if (i % 10u == 0u) {
+				diff += "VarInt(\"v" + to_string(i) + "\", 0) [rename] VarInt(\"w" + to_string(i) + "\", 1)\n";
+			}
+		}
+		StringParser::Parser parser{};
+		string parsed{};
+		if (!parser.SetDiff(diff) || !parser.SetTarget(target) || !parser.Parse(parsed)) {
+			std::cout << "Merge: parse failed, see the log\n";
+			return false;
+		}
+
+		StringParser::Parser::DiffTree diff_tree{};
+		StringParser::Parser::TargetTree target_tree{};
+		if (!diff_tree.Generate(diff) || !target_tree.Generate(diff_tree.GetTargetPath(), target)) {
+			std::cout << "Merge: tree generation failed, see the log\n";
+			return false;
+		}
+		string merged{};
+		const auto start{ Clock::now() };
+		for (szt i{ 0u }; i < MERGES; ++i) {
+			if (!StringParser::Parser::Merge(diff_tree, target_tree, merged)) {
+				std::cout << "Merge: merge failed, see the log\n";
+				return false;
+			}
+		}
+		std::cout << "Merge: merged into " << count << " entries " << MERGES << " times in " << Milliseconds(start) << " ms\n";
+		if (merged != parsed) {
+			std::cout << "Merge: the merged output differs from the parsed one\n";
+			return false;
+		}
+		return true;
+	}
+
+	//A script made of boilerplate every script shares, a block only every fourth script has and a few lines unique to it
+	[[nodiscard]] string MakeScript(szt file, szt groups) {
+		string script{ "import \"common.scr\"\nimport \"items.scr\"\nexport int ID = " + to_string(file) + ";\nsub main()\n{\n\tuse Common();\n\tuse Items();\n" };
+		for (szt g{ 0u }; g < groups; ++g) {
+			script += "\tGroup(\"g" + to_string(g) + "\") {\n\t\tItem(\"rope\") {\n\t\t\tWeight(1.5);\n\t\t\tPrice(10);\n\t\t}\n";
+			if (file % 4u == 0u) {
+				script += "\t\tItem(\"torch\") {\n\t\t\tWeight(0.5);\n\t\t\tLight(1);\n\t\t}\n";
+			}
+			script += "\t\tSpawn(\"s" + to_string(file) + "_" + to_string(g) + "\", " + to_string(g) + ");\n\t}\n";
+		}
+		return script + "}\n";
+	}
+
+	//Generates count scripts into one node store, then checks one merge reads the same from the store as from the tree's own nodes
+	[[nodiscard]] bool BenchNodeStore(szt count) {
+		constexpr szt GROUPS{ 20u };
+		const string diff{ "scripts/s0.scr\nsub main() {\n\tGroup(\"g0\") {\n\t\tItem(\"rope\") {\n\t\t\tPrice(10) [rename] Price(12);\n\t\t}\n\t\tAdded(1) [insert];\n\t}\n}\n" };
+		StringParser::Parser::DiffTree diff_tree{};
+		if (!diff_tree.Generate(diff)) {
+			std::cout << "NodeStore: diff generation failed, see the log\n";
+			return false;
+		}
+		vector<StringParser::Parser::TargetTree> trees(count);
+		for (szt i{ 0u }; i < count; ++i) {
+			if (!trees[i].Generate(diff_tree.GetTargetPath(), MakeScript(i, GROUPS))) {
+				std::cout << "NodeStore: tree generation failed, see the log\n";
+				return false;
+			}
+		}
+		string unstored{}, stored{};
+		if (count == 0u || !StringParser::Parser::Merge(diff_tree, trees[0], unstored)) {
+			std::cout << "NodeStore: merge failed, see the log\n";
+			return false;
+		}
+
+		StringParser::Parser::NodeStore store{};
+		const auto start{ Clock::now() };
+		for (auto& tree : trees) {
+			if (!tree.Intern(store)) {
+				std::cout << "NodeStore: interning failed, see the log\n";
+				return false;
+			}
+		}
+		const double interned{ Milliseconds(start) };
+		const auto merge{ Clock::now() };
+		if (!StringParser::Parser::Merge(diff_tree, trees[0], stored)) {
+			std::cout << "NodeStore: merge from the store failed, see the log\n";
+			return false;
+		}
+		const double merged{ Milliseconds(merge) };
+		//Trees keep a placement per node either way, so the saving is in the nodes themselves
+		const szt placements{ store.Interned() * sizeof(StringParser::Parser::NodeStore::Placement) };
+		std::cout << "NodeStore: " << count << " scripts, " << store.Interned() << " nodes stored as " << store.Size() << " (" << store.DedupRatio() << "x) in "
+			<< interned << " ms, about " << store.Interned() * sizeof(StringParser::Parser::Node) / 1024u << " KiB of nodes down to " << (store.Bytes() + placements) / 1024u
+			<< " KiB with placements, one merge from the store in " << merged << " ms\n";
+		if (stored != unstored) {
+			std::cout << "NodeStore: the merge from the store differs from the one before\n";
+			return false;
+		}
+		return true;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	logger.Init();
+	const szt count{ argc > 1 ? static_cast<szt>(std::stoull(argv[1])) : 40000u };
+	const szt scripts{ argc > 2 ? static_cast<szt>(std::stoull(argv[2])) : 1000u };
+	BenchCache(count);
+	const bool same{ BenchVarlist(count) && BenchCompiledDiff(count) && BenchMerge(count) && BenchNodeStore(scripts) };
+	logger.Close();
+	return same ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "Common.h"
+
+#include <zlib.h>
+
+#include <filesystem>
+#include <fstream>
+#include <utility>
+
+
+//Minimal zip writer for the benchmarks, so their archives don't depend on what the libzippp in use writes. No zip64, so every size and
+//offset must fit in 32 bits.
+namespace ZipWriter {
+
+	constexpr uint32 STORED{ 0u };
+	constexpr uint32 DEFLATED{ 8u };
+
+	inline void Put16(string& out, uint32 value) { out += static_cast<char>(value & 0xFFu); out += static_cast<char>((value >> 8u) & 0xFFu); }
+	inline void Put32(string& out, uint32 value) { Put16(out, value & 0xFFFFu); Put16(out, value >> 16u); }
+
+	[[nodiscard]] inline bool Deflate(string_view data, string& out) {
+		z_stream stream{};
+		if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			return false;
+		}
+		out.resize(deflateBound(&stream, static_cast<uLong>(data.size())));
+		stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+		stream.avail_in = static_cast<uInt>(data.size());
+		stream.next_out = reinterpret_cast<Bytef*>(out.data());
+		stream.avail_out = static_cast<uInt>(out.size());
+		const bool done{ deflate(&stream, Z_FINISH) == Z_STREAM_END };
+		out.resize(stream.total_out);
+		deflateEnd(&stream);
+		return done;
+	}
+
+	//entries are (name, contents) pairs, all written with method
+	[[nodiscard]] inline bool Write(const std::filesystem::path& file, const vector<std::pair<string, string>>& entries, uint32 method) {
+		string out{}, central{}, data{};
+		for (const auto& [name, text] : entries) {
+			if (method != DEFLATED) {
+				data = text;
+			}
+			else if (!Deflate(text, data)) {
+				return false;
+			}
+			const uint32 crc{ static_cast<uint32>(crc32(0u, reinterpret_cast<const Bytef*>(text.data()), static_cast<uInt>(text.size()))) };
+			const uint32 offset{ static_cast<uint32>(out.size()) };
+			Put32(out, 0x04034b50u); Put16(out, 20u); Put16(out, 0u); Put16(out, method); Put32(out, 0u);
+			Put32(out, crc); Put32(out, static_cast<uint32>(data.size())); Put32(out, static_cast<uint32>(text.size()));
+			Put16(out, static_cast<uint32>(name.size())); Put16(out, 0u);
+			out += name;
+			out += data;
+			Put32(central, 0x02014b50u); Put16(central, 20u); Put16(central, 20u); Put16(central, 0u); Put16(central, method); Put32(central, 0u);
+			Put32(central, crc); Put32(central, static_cast<uint32>(data.size())); Put32(central, static_cast<uint32>(text.size()));
+			Put16(central, static_cast<uint32>(name.size())); Put16(central, 0u); Put16(central, 0u); Put16(central, 0u); Put16(central, 0u);
+			Put32(central, 0u); Put32(central, offset);
+			central += name;
+		}
+		const uint32 central_offset{ static_cast<uint32>(out.size()) };
+		out += central;
+		Put32(out, 0x06054b50u); Put16(out, 0u); Put16(out, 0u);
+		Put16(out, static_cast<uint32>(entries.size())); Put16(out, static_cast<uint32>(entries.size()));
+		Put32(out, static_cast<uint32>(central.size())); Put32(out, central_offset); Put16(out, 0u);
+		std::ofstream ofs{ file, std::ios::binary | std::ios::trunc };
+		return ofs.is_open() && ofs.write(out.data(), static_cast<std::streamsize>(out.size()));
+	}
+
+}
@@ -0,0 +1,47 @@
+#include "logger.h"
+#include "PakReader.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+
+//libFuzzer entry point for PakReader. PakReader only opens files, so each input is written to a file of this process's own first.
+//Every entry of an archive that opens is read whole and through a small chunk buffer, and viewed if stored.
+namespace {
+
+	const std::filesystem::path& InputPath() {
+		static const std::filesystem::path file{ std::filesystem::temp_directory_path() / ("PakReaderFuzz_" + std::to_string(reinterpret_cast<std::uintptr_t>(&file)) + ".pak") };
+		return file;
+	}
+
+}
+
+extern "C" int LLVMFuzzerInitialize(int*, char***) {
+	logger.Init();
+	return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size) {
+	{
+		std::ofstream ofs{ InputPath(), std::ios::binary | std::ios::trunc };
+		if (!ofs.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size))) {
+			return 0;
+		}
+	}
+	PakReader reader{};
+	if (!reader.Open(InputPath())) {
+		return 0;
+	}
+	char buffer[256];
+	string text{};
+	string_view view{};
+	for (szt i{ 0u }; i < reader.Entries().size(); ++i) {
+		static_cast<void>(reader.Read(i, text));
+		static_cast<void>(reader.Read(i, buffer, sizeof(buffer), [](string_view) { return true; }));
+		static_cast<void>(reader.View(i, view));
+		static_cast<void>(reader.Extent(i));
+	}
+	return 0;
+}
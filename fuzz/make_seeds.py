@@ -0,0 +1,59 @@
+#Writes the seed archives in seeds/ that PakReaderFuzz starts from. Each one covers a layout PakReader parses differently.
+#Usage: python make_seeds.py
+import io
+import os
+import struct
+import zipfile
+
+SEEDS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "seeds")
+TEXT = b"sub main()\n{\n\tVarInt(\"x\", 1);\n\tVarFloat(\"y\", 2.0);\n}\n" * 4
+
+
+def archive(entries, comment=b"", zip64=False):
+	#Lowering zipfile's limits makes it write every zip64 record, which it otherwise only does for archives too big to be seeds
+	limits = (zipfile.ZIP64_LIMIT, zipfile.ZIP_FILECOUNT_LIMIT)
+	if zip64:
+		zipfile.ZIP64_LIMIT, zipfile.ZIP_FILECOUNT_LIMIT = 0, 0
+	try:
+		out = io.BytesIO()
+		with zipfile.ZipFile(out, "w") as pak:
+			for name, data, method in entries:
+				info = zipfile.ZipInfo(name, date_time=(2020, 1, 1, 0, 0, 0))
+				info.compress_type = method
+				with pak.open(info, "w", force_zip64=zip64) as entry:
+					entry.write(data)
+			pak.comment = comment
+		return out.getvalue()
+	finally:
+		zipfile.ZIP64_LIMIT, zipfile.ZIP_FILECOUNT_LIMIT = limits
+
+
+def oversized(pak):
+	#Claims nearly 4 GiB for both sizes of every entry, which the data that is actually there can't back
+	pak = bytearray(pak)
+	for signature, offset in ((b"PK\x03\x04", 18), (b"PK\x01\x02", 20)):
+		at = pak.find(signature)
+		while at != -1:
+			struct.pack_into("<II", pak, at + offset, 0xFFFFFFFE, 0xFFFFFFFE)
+			at = pak.find(signature, at + 4)
+	return bytes(pak)
+
+
+def main():
+	os.makedirs(SEEDS, exist_ok=True)
+	seeds = {
+		"empty.pak": archive([]),
+		"stored.pak": archive([("scripts/a.scr", TEXT, zipfile.ZIP_STORED)]),
+		"deflated.pak": archive([("scripts/a.scr", TEXT, zipfile.ZIP_DEFLATED)]),
+		"mixed.pak": archive([("scripts/", b"", zipfile.ZIP_STORED), ("scripts/a.scr", TEXT, zipfile.ZIP_STORED), ("scripts/b.loot", TEXT, zipfile.ZIP_DEFLATED)]),
+		"zip64.pak": archive([("scripts/a.scr", TEXT, zipfile.ZIP_STORED), ("scripts/b.scr", TEXT, zipfile.ZIP_DEFLATED)], zip64=True),
+		"comment.pak": archive([("scripts/a.scr", TEXT, zipfile.ZIP_DEFLATED)], comment=b"PK\x05\x06 inside the comment"),
+		"oversized.pak": oversized(archive([("scripts/a.scr", TEXT, zipfile.ZIP_STORED), ("scripts/b.scr", TEXT, zipfile.ZIP_DEFLATED)])),
+	}
+	for name, data in seeds.items():
+		with open(os.path.join(SEEDS, name), "wb") as seed:
+			seed.write(data)
+
+
+if __name__ == "__main__":
+	main()
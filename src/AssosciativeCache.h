@@ -1,6 +1,7 @@
 #pragma once
 #include "Common.h"
 #include "logger.h"
+#include <algorithm>
 #include <mutex>
 
 
@@ -12,20 +13,51 @@ public:
 	using CacheCIterator = CacheMap::const_iterator;
 	static constexpr ID NULL_ID{ std::numeric_limits<ID>::min() };
 
+	AssosciativeCache() = default;
+	//Overlay on top of base, which must outlive it and not change meanwhile. Values in base keep their IDs and new ones continue after base's.
+	//Only the new values are stored, so an overlay of a large cache is as cheap to make as an empty cache.
+	explicit AssosciativeCache(const AssosciativeCache* base) : base(base), firstID(base->nextID), nextID(base->nextID), reverse{} {}
+	AssosciativeCache(const AssosciativeCache& rhs) : cache(rhs.cache), base(rhs.base), firstID(rhs.firstID), nextID(rhs.nextID) { RebuildReverse(); }
+	AssosciativeCache(AssosciativeCache&&) noexcept = default;
+	AssosciativeCache& operator=(const AssosciativeCache& rhs) {
+		if (this != &rhs) {
+			cache = rhs.cache;
+			base = rhs.base;
+			firstID = rhs.firstID;
+			nextID = rhs.nextID;
+			RebuildReverse();
+		}
+		return *this;
+	}
+	AssosciativeCache& operator=(AssosciativeCache&&) noexcept = default;
+	~AssosciativeCache() = default;
+
 
 	[[nodiscard]] ID Find(const Value& val) const noexcept {
+		if (base) {
+			if (const ID id{ base->Find(val) }; id != NULL_ID) {
+				return id;
+			}
+		}
 		if (CacheCIterator iter{ cache.find(val) }; iter != cache.end()) {
 			return iter->second;
 		}
 		return ID{ NULL_ID };
 	}
 	[[nodiscard]] ID FindOrAdd(const Value& val) noexcept {
+		if (base) {
+			if (const ID id{ base->Find(val) }; id != NULL_ID) {
+				return id;
+			}
+		}
 		if (CacheCIterator iter{ cache.find(val) }; iter != cache.end()) {
 			return iter->second;
 		}
 		else {
 			try {
+				ReserveReverse(); //So storing the reverse entry below cannot throw after inserting
 				if (auto result{ cache.insert({ val, nextID }) }; result.second) {
+					StoreReverse(result.first);
 					++nextID;
 					return result.first->second;
 				}
@@ -37,12 +69,19 @@ public:
 		}
 	}
 	[[nodiscard]] ID FindOrAdd(Value&& val) noexcept {
+		if (base) {
+			if (const ID id{ base->Find(val) }; id != NULL_ID) {
+				return id;
+			}
+		}
 		if (CacheCIterator iter{ cache.find(val) }; iter != cache.end()) {
 			return iter->second;
 		}
 		else {
 			try {
+				ReserveReverse(); //So storing the reverse entry below cannot throw after inserting
 				if (auto result{ cache.insert({ val, nextID }) }; result.second) {
+					StoreReverse(result.first);
 					++nextID;
 					return result.first->second;
 				}
@@ -54,11 +93,13 @@ public:
 		}
 	}
 	
+	//Constant time through the reverse table. Map nodes never move, so the stored pointers stay valid until their entry is deleted.
 	[[nodiscard]] const Value& Find(const ID id) const noexcept {
-		for (const auto& [value, id_] : cache) {
-			if (id == id_) {
-				return value;
-			}
+		if (const szt slot{ static_cast<szt>(id - firstID) }; id >= firstID && slot < reverse.size() && reverse[slot]) {
+			return *reverse[slot];
+		}
+		if (base && id < firstID) {
+			return base->Find(id);
 		}
 		return cache.cbegin()->first;
 	}
@@ -69,6 +110,7 @@ public:
 				return false;
 			}
 			if (CacheCIterator iter = cache.find(val); iter != cache.end()) {
+				EraseReverse(iter->second);
 				cache.erase(iter);
 				return true;
 			}
@@ -82,32 +124,68 @@ public:
 		if (id == NULL_ID) [[unlikely]] {
 			return false;
 		}
-		for (CacheCIterator iter{ cache.begin() }; iter != cache.end(); ++iter) {
-			if (iter->second == id) {
-				cache.erase(iter);
-				return true;
-			}
+		if (const szt slot{ static_cast<szt>(id - firstID) }; id >= firstID && slot < reverse.size() && reverse[slot]) {
+			cache.erase(cache.find(*reverse[slot]));
+			reverse[slot] = nullptr;
+			return true;
 		}
 		return false;
 	}
 
 	szt Size() const noexcept { return cache.size(); }
-	//Resets the cache to its construction state, leaving it with only 1 pair of {Value{}, NULL_ID}. Next ID assigned will be NULL_ID + 1.
+	//Resets the cache to its construction state, leaving it with only 1 pair of {Value{}, NULL_ID}. Next ID assigned will be NULL_ID + 1, or the first after base's for an overlay.
 	void Reset() noexcept {
 		if (cache.size() < 2u) { //Nothing inside but the default pair
 			return;
 		}
 		cache.erase(++cache.cbegin(), cache.cend());
-		nextID = ID{ NULL_ID + 1 };
+		nextID = (base ? firstID : ID{ NULL_ID + 1 });
+		RebuildReverse();
 	}
-	//Completely clears the cache, including the default constructed first element. Next ID assigned will be NULL_ID.
-	void Clear() noexcept { cache.clear(); nextID = ID{ NULL_ID }; }
+	//Completely clears the cache, including the default constructed first element and any base. Next ID assigned will be NULL_ID.
+	void Clear() noexcept { cache.clear(); reverse.clear(); base = nullptr; firstID = ID{ NULL_ID }; nextID = ID{ NULL_ID }; }
 
 private:
-	CacheMap cache{ {Value{}, NULL_ID} };
+	CacheMap cache{ {Value{}, NULL_ID} };	//An overlay keeps its own default pair too, so Find(id) always has something to return
+	const AssosciativeCache* base{ nullptr };	//See the overlay constructor
+	ID firstID{ NULL_ID };						//First ID stored here rather than in base
 	ID nextID{ NULL_ID + 1 };
+	vector<const Value*> reverse{ &cache.cbegin()->first };	//Slot (id - firstID) points to id's value, or nullptr if deleted
+
+	//Grows geometrically, since reserving exactly one more slot per insert would reallocate the table every time
+	void ReserveReverse() {
+		if (const szt needed{ static_cast<szt>(nextID - firstID) + 1u }; needed > reverse.capacity()) {
+			reverse.reserve(std::max(2u * reverse.capacity(), needed));
+		}
+	}
+	void StoreReverse(CacheCIterator iter) noexcept {
+		const szt slot{ static_cast<szt>(iter->second - firstID) };
+		if (slot >= reverse.size()) {
+			reverse.resize(slot + 1u, nullptr); //Reserved by the caller
+		}
+		reverse[slot] = &iter->first;
+	}
+	void EraseReverse(const ID id) noexcept {
+		if (const szt slot{ static_cast<szt>(id - firstID) }; id >= firstID && slot < reverse.size()) {
+			reverse[slot] = nullptr;
+		}
+	}
+	void RebuildReverse() noexcept {
+		reverse.clear();
+		try {
+			reverse.resize(static_cast<szt>(nextID - firstID), nullptr);
+			for (const auto& [value, id] : cache) {
+				if (id >= firstID) { //Not an overlay's default pair, whose ID belongs to base
+					reverse[static_cast<szt>(id - firstID)] = &value;
+				}
+			}
+		}
+		catch (...) {
+			logger.Error("Cache failed to rebuild its reverse lookup table. Possibly out of memory?"sv);
+		}
+	}
 };
-static_assert(sizeof(AssosciativeCache<string, uint64>) == 24u);
+static_assert(sizeof(AssosciativeCache<string, uint64>) == 64u);
 
 
 template <typename Value, typename ID = uint64> requires (std::integral<ID>)
@@ -28,15 +28,19 @@ constexpr string PREFIX_POINT{ " > " };
 
 std::atomic<bool> active{ false };
 
-const array<string, 8> base{			//Base message for each line
+const array<string, 12> base{			//Base message for each line
 	"Diff directory: ",					//0
 	".pak directory: ",					//1
 	"Parse without committing",			//2
 	"Parse and commit",					//3
 	"Commit parsed files",				//4
-	"Reset Program",					//5
-	"Clear Console",					//6
-	"Close",							//7
+	"Compile diffs",					//5
+	"Parallel merge: ",					//6
+	"Lazy targets: ",					//7
+	"Parallel parse: ",					//8
+	"Reset Program",					//9
+	"Clear Console",					//10
+	"Close",							//11
 };
 array<string, base.size()> prefixes{	//Prefix for each line's message. Used for selection indicator.
 	PREFIX_POINT,
@@ -47,22 +51,35 @@ array<string, base.size()> prefixes{	//Prefix for each line's message. Used for
 	PREFIX_EMPTY,
 	PREFIX_EMPTY,
 	PREFIX_EMPTY,
+	PREFIX_EMPTY,
+	PREFIX_EMPTY,
+	PREFIX_EMPTY,
+	PREFIX_EMPTY,
 };	
-array<string, base.size()> suffixes{};	//Suffix for each line's message. Used for dirs.
+array<string, base.size()> suffixes{	//Suffix for each line's message. Used for dirs and option states.
+	"", "", "", "", "", "",
+	"off",								//6
+	"off",								//7
+	"off",								//8
+};
 szt pos{ 0 };							//Position of selected line. Used to set pointy prefix and many other things like cleansing text.
 string infoline{};						//Extra line at the bottom for info etc
 
-const array<string, 10> INFOLINE_MSGS{
+const array<string, 14> INFOLINE_MSGS{
 	"The directory containing the diffs. Press Enter to change.",							//0
 	"The directory containing the target .pak files. Press Enter to change.",				//1
 	"Press Enter to generate the parsed files, without committing them to their .pak file.",//2
 	"Press Enter to generate the parsed files and commit them to their .pak file.",			//3
 	"Press Enter to commit previously generated parsed files to their .pak file.",			//4
-	"Press Enter to reset the directories and the loaded/generated files.",					//5
-	"Press Enter to clear the console.",													//6
-	"Press Enter to close the program.",													//7
-	"New directory:",																		//8
-	"Press any key to exit...",																//9
+	"Press Enter to compile the diffs to patch programs in a directory of your choice.",	//5
+	"Press Enter to toggle merging the top level nodes of each file on several threads.",	//6
+	"Press Enter to toggle generating only the parts of each target its diffs reach.",		//7
+	"Press Enter to toggle parsing one target per hardware thread at once.",				//8
+	"Press Enter to reset the directories and the loaded/generated files.",					//9
+	"Press Enter to clear the console.",													//10
+	"Press Enter to close the program.",													//11
+	"New directory:",																		//12
+	"Press any key to exit...",																//13
 };
 enum InfolineIdxs : szt {
 	NewDirIdx = base.size(),
@@ -72,6 +89,9 @@ enum InfolineIdxs : szt {
 queue_type message_queue{};			//Message queue for additional messages like logger outputs
 MessageQueue* mqPtr = nullptr;
 FileManager file_manager{};
+bool parallel_merge{ false };			//Options are kept across resets, unlike the directories
+bool lazy_targets{ false };
+bool parallel_parse{ false };
 
 void (*GetMQ)(queue_type& q) noexcept = [](queue_type& q) noexcept { q.clear(); };
 
@@ -299,7 +319,8 @@ namespace ConsoleUtils {
 		try {
 			prefixes.fill(PREFIX_EMPTY);
 			prefixes[0] = PREFIX_POINT;
-			suffixes.fill("");
+			suffixes[0].clear();
+			suffixes[1].clear();
 			pos = 0;
 			infoline.clear();
 		}
@@ -704,17 +725,53 @@ void ConsoleHandler::Start() const noexcept{
 				logger.NoSeverity(GetTimeString() + ": Initiating commit...");
 				file_manager.Commit();
 			}
-			else if (pos == 5) { //Reset Program
+			else if (pos == 5) { //Compile diffs
+				CleanseInfoline();
+				PrintInfolineMessage(NewDirIdx);
+				ShowCursor();
+				try {
+					string dir{};
+					const bool gotDir{ ReadDir(NewDirIdx, dir) };
+					HideCursor();
+					CleanseAll(false);
+					if (gotDir) {
+						logger.NoSeverity(GetTimeString() + ": Initiating compile...");
+						file_manager.CompileDiffs(dir);
+					}
+				}
+				catch (...) {
+					StringCtorFailAndExit();
+				}
+			}
+			else if (pos == 6) { //Toggle parallel merge
+				CleanseAll(false);
+				parallel_merge = !parallel_merge;
+				file_manager.SetParallelMerge(parallel_merge);
+				suffixes[pos] = parallel_merge ? "on" : "off";
+			}
+			else if (pos == 7) { //Toggle lazy targets
+				CleanseAll(false);
+				lazy_targets = !lazy_targets;
+				file_manager.SetLazyTargets(lazy_targets);
+				suffixes[pos] = lazy_targets ? "on" : "off";
+			}
+			else if (pos == 8) { //Toggle parallel parse
+				CleanseAll(false);
+				parallel_parse = !parallel_parse;
+				file_manager.SetParseWorkers(parallel_parse ? 0u : 1u);
+				suffixes[pos] = parallel_parse ? "on" : "off";
+			}
+			else if (pos == 9) { //Reset Program
 				CleanseAll(false);
 				Reset();
 				file_manager.Reset();
 				logger.NoSeverity(GetTimeString() + ": Program has been reset.");
 			}
-			else if (pos == 6) { //Clear Console
+			else if (pos == 10) { //Clear Console
 				CleanseAll(false);
 				mqPtr->Clear();
 			}
-			else if (pos == 7) { //Close
+			else if (pos == 11) { //Close
 				FlushAndClose();
 			}
 		}
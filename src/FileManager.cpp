@@ -1,15 +1,27 @@
 #include "FileManager.h"
 #include "Logger.h"
+#include "MappedFile.h"
 #include "StringParser.h"
-
-#include "libzippp.h"
+#include "PatchProgram.h"
+#include "ThreadPool.h"
 
 #include <fstream>
-#include <sstream>
 
 #include <algorithm>
+#include <atomic>
+#include <unordered_map>
+
+//	FileManager::ParseSession
 
-using namespace libzippp;
+//State JustParse() shares between its workers
+struct FileManager::ParseSession {
+	vector<string> diff_strs{};			//Text diffs, moved out by the worker that parses their group
+	vector<MappedFile> programs{};		//Compiled diffs, which the parser reads straight from the mapping
+	vector<vector<szt>> groups{};		//Indices into diffs of the diffs sharing a target, in diffs order
+	vector<const PakIndex::Entry*> target_entries{};	//Per group, its target as named by the group's first diff. nullptr if no archive has it.
+	vector<std::optional<string>> target_texts{};		//Per group, its target if it was inflated ahead of the parser
+	szt prefetched{ 0u };
+};
 
 
 //	FiloeManager public
@@ -48,80 +60,44 @@ bool FileManager::Commit() noexcept {
 	}
 
 	try {
-		vector<ZipArchive*> paks; //Open .pak archives as specified in targets
-		auto freePaks = [&](bool msg = true) {
-			for (auto pak : paks) {
-				if (pak->close() != LIBZIPPP_OK && msg) {
-					logger.Warning("Archive <{}> was not closed successfully and changes to it might not go through."sv, pak->getPath());
-				}
-				delete pak;
-			}
-		};
-		paks.reserve(targets.size());
-		for (const auto& target : targets) {
-			ZipArchive* newpak = new ZipArchive{ target.string() };
-			newpak->open(ZipArchive::Write);
-			if (!newpak || !newpak->isOpen()) {
-				logger.Error("Failed to open .pak file <{}>. Commit aborted with no changes made."sv, target.string());
-				parsed.clear();
-				if (newpak) { freePaks(false); }
-				return false;
-			}
-			paks.push_back(newpak);
+		//The session JustParse() opened is kept, but it's closed if the .pak directory changed since or an earlier commit failed
+		if (!paks.Open(targets)) {
+			logger.Error("Failed to open .pak files. Commit aborted with no changes made."sv);
+			return false;
 		}
 
-		vector<string> temp_filenames{};
-		temp_filenames.reserve(parsed.size());
+		//Find every parsed file's entry, then open only the archives that receive one for writing
+		vector<const PakIndex::Entry*> entries{};
+		entries.reserve(parsed.size());
 		for (const auto& p : parsed) {
-			bool handled{ false };
-			for (auto pak : paks) {
-				if (pak->hasEntry(p.first, false, false)) { //Case insensitive
-					//Put parsed string in a temp file
-					string temp_filename{ path{ p.first }.filename().string() + ".temp" };
-					std::ofstream ofs{ temp_filename };
-					if (!ofs.is_open()) {
-						logger.Error("Failed to create temp file <{}>. Commit aborted but some files may have been patched."sv, temp_filename);
-						freePaks();
-						return false;
-					}
-					ofs << p.second;
-					ofs.close();
-					//Add the temp file to the archive
-					if (!pak->addFile(p.first, temp_filename)) {
-						logger.Error("Failed to add parsed <{}> to archive. Commit aborted but some files may have been patched."sv, path{ p.first }.filename().string());
-						freePaks();
-						return false;
-					}
-					temp_filenames.push_back(std::move(temp_filename));
-					//Move on to the next parsed string
-					handled = true;
-					break;
-				}
+			const PakIndex::Entry* entry{ paks.Index().Find(p.first) };
+			if (!entry) {
+				logger.Error("Failed to find file <{}> in any of the archives. Commit aborted with no changes made."sv, p.first);
+				return false;
 			}
-
-			if (!handled) {
-				logger.Error("Failed to find file <{}> in any of the archives. Commit aborted but some files may have been patched."sv);
-				freePaks();
+			entries.push_back(entry);
+		}
+		for (const auto entry : entries) {
+			if (!paks.OpenForWrite(entry->archive)) {
+				logger.Error("Failed to open .pak file <{}>. Commit aborted with no changes made."sv, targets[entry->archive].string());
+				parsed.clear();
+				paks.Close();
 				return false;
 			}
 		}
 
-		//Close and free archives
-		freePaks();
-
-		//Delete the temp files
-		for (const auto& tmp : temp_filenames) {
-			std::error_code ec{};
-			if (!std::filesystem::remove(path{ tmp }, ec)) {
-				if (ec.value() == 0) {
-					logger.Warning("Failed to delete temp file <{}> after commiting with no specified error."sv, tmp);
-				}
-				else {
-					logger.Warning("Failed to delete temp file <{}> after commiting with OS error <{}>."sv, tmp, ec.message());
-				}
+		//Hand libzippp the parsed strings themselves. It reads them when the archive is closed, so parsed must not change until paks.Close().
+		for (szt i{ 0u }; i < parsed.size(); ++i) {
+			if (!paks.AddData(*entries[i], parsed[i].second)) {
+				logger.Error("Failed to add parsed <{}> to archive. Commit aborted but some files may have been patched."sv, path{ parsed[i].first }.filename().string());
+				paks.Close();
+				return false;
 			}
 		}
 
+		//Close the archives, which writes the added data
+		paks.Close();
+
 		//Reset after commit
 		logger.Info("Successfully committed {} parsed files!"sv, parsed.size());
 		Reset();
@@ -135,7 +111,7 @@ bool FileManager::Commit() noexcept {
 
 void FileManager::ToFiles() noexcept {
 	for (const auto& p : parsed) {
-		std::ofstream ofs{ "PARSED_" + path{ p.first }.filename().string() };
+		std::ofstream ofs{ "PARSED_" + path{ p.first }.filename().string(), std::ios::binary }; //p.second already has the line endings Commit() stores
 		if (!ofs.is_open()) {
 			logger.Warning("Failed to dump parsed <{}> to file"sv, path{ p.first }.filename().string());
 			continue;
@@ -145,10 +121,63 @@ void FileManager::ToFiles() noexcept {
 	}
 }
 
+bool FileManager::CompileDiffs(const string& out_dir) noexcept {
+	if (diffs.empty()) {
+		logger.Error("A folder of diff files must be provided before compiling. Request ignored."sv);
+		return false;
+	}
+	try {
+		path dir{ out_dir };
+		std::error_code ec{};
+		create_directories(dir, ec);
+		if (!is_directory(dir)) {
+			logger.Error("Failed to create directory <{}> for compiled diffs"sv, out_dir);
+			return false;
+		}
+
+		StringParser::Parser parser{};
+		szt compiled{ 0u };
+		for (const auto& diff : diffs) {
+			MappedFile mapped{};
+			string diff_str{}, program{};
+			if (!ReadDiff(diff, mapped, diff_str)) {
+				logger.Error("Failed to open diff <{}>. Compile aborted."sv, diff.string());
+				return false;
+			}
+			if (StringParser::PatchProgram::IsProgram(mapped.View())) {
+				logger.Info("Diff <{}> is already compiled. Skipped."sv, diff.string());
+				continue;
+			}
+			if (!parser.SetDiff(std::move(diff_str)) || !parser.CompileDiff(program)) {
+				logger.Error("Failed to compile diff <{}>. Compile aborted."sv, diff.string());
+				return false;
+			}
+			const path out_file{ dir / (diff.filename().string() + ".dpp") };
+			std::ofstream ofs{ out_file, std::ios::binary };
+			if (!ofs.is_open() || !ofs.write(program.data(), program.size())) {
+				logger.Error("Failed to write compiled diff <{}>. Compile aborted."sv, out_file.string());
+				return false;
+			}
+			++compiled;
+		}
+		logger.Info("Compiled {} diffs to <{}>"sv, compiled, out_dir);
+		return true;
+	}
+	catch (...) {
+		logger.Error("Unknown exception while compiling diffs. Compile aborted."sv);
+		return false;
+	}
+}
+
+void FileManager::SetParallelMerge(bool enable) noexcept { parallel_merge = enable; }
+void FileManager::SetLazyTargets(bool enable) noexcept { lazy_targets = enable; }
+void FileManager::SetParseWorkers(szt count) noexcept { parse_workers = count; }
+
 void FileManager::Reset() noexcept {
 	diffs.clear();
 	targets.clear();
 	parsed.clear();
+	paks.Close();
 }
 
 
@@ -164,83 +193,100 @@ bool FileManager::JustParse() noexcept {
 	parsed.reserve(diffs.size());
 
 	try {
-		vector<ZipArchive*> paks; //Open .pak archives as specified in targetsauto freePaks = [&](bool msg = true) {
-		auto freePaks = [&](bool msg = true) {
-			for (auto pak : paks) {
-				if (pak->close() != LIBZIPPP_OK && msg) {
-					logger.Warning("Archive <{}> was not closed successfully and changes to it might not go through."sv, pak->getPath());
-				}
-				delete pak;
-			}
-		};
-		paks.reserve(targets.size());
-		for (const auto& target : targets) {
-			ZipArchive* newpak = new ZipArchive{ target.string() };
-			newpak->open(ZipArchive::ReadOnly);
-			if (!newpak || !newpak->isOpen()) {
-				logger.Error("Failed to open .pak file <{}>. Parse aborted."sv, target.string());
+		//Read every diff up front and group them by target, so each target is read and generated once with all of its diffs applied in file name order
+		ParseSession session{};
+		session.diff_strs.resize(diffs.size());
+		session.programs.resize(diffs.size());
+		std::unordered_map<string, szt> group_of{};
+		std::atomic<szt> file_copies{ 0u };	//Whole-file buffers made of diff and target texts, reported once parsing is done
+		for (szt i{ 0u }; i < diffs.size(); ++i) {
+			if (!ReadDiff(diffs[i], session.programs[i], session.diff_strs[i])) {
+				logger.Error("Failed to open diff <{}>. Parse aborted."sv, diffs[i].string());
 				parsed.clear();
-				if (newpak) { freePaks(false); }
 				return false;
 			}
-			paks.push_back(newpak);
-		}
 
-		StringParser::Parser parser{};
-		for (const auto& diff : diffs) {
-			//Get and set diff file string
-			std::ifstream ifs{ diff };
-			if (!ifs.is_open()) {
-				logger.Error("Failed to open diff <{}>. Parse aborted."sv, diff.string());
-				parsed.clear();
-				freePaks();
-				return false;
+			string key{}; //Target path, as the parser reads it
+			if (const string_view program{ session.programs[i].View() }; !StringParser::PatchProgram::IsProgram(program)) {
+				++file_copies; //ReadDiff() copied it out of its mapping
+				key = session.diff_strs[i].substr(0u, session.diff_strs[i].find('\n'));
+				StringUtils::RemoveLeadingAndTrailingWhitespace(key);
 			}
-			std::stringstream ss{};
-			ss << ifs.rdbuf();
-			const string diff_str{ ss.str() };
-			ifs.close();
-			if (!parser.SetDiff(diff_str)) {
-				logger.Error("Failed to set diff <{}>. Parse aborted."sv, diff.string());
+			else if (!StringParser::PatchProgram::ReadTargetPath(program, key)) {
+				logger.Error("Compiled diff <{}> is corrupt. Parse aborted."sv, diffs[i].string());
 				parsed.clear();
-				freePaks();
 				return false;
 			}
-
-			//Get and set target file string
-			const string path_of_target{ parser.GetTargetPath() };
-			ZipEntry target_entry{};
-			for (const auto pak : paks) {
-				target_entry = pak->getEntry(path_of_target);
-				if (!target_entry.isNull()) {
-					break;
-				}
+			//Grouped by the name the archives are indexed by, so scripts\x.scr and Scripts/x.scr patch the same target
+			auto [slot, added] { group_of.try_emplace(PakIndex::Normalize(key), session.groups.size()) };
+			if (added) {
+				session.groups.emplace_back();
 			}
-			if (target_entry.isNull()) {
-				logger.Error("Failed to locate target <{}> requested in diff <{}>. Parse aborted."sv, path_of_target, diff.string());
-				parsed.clear();
-				freePaks();
+			session.groups[slot->second].push_back(i);
+		}
+
+		if (!paks.Open(targets)) {
+			logger.Error("Failed to open .pak files. Parse aborted."sv);
+			parsed.clear();
+			return false;
+		}
+		session.target_entries.resize(session.groups.size());
+		session.target_texts.resize(session.groups.size());
+		for (const auto& [key, group] : group_of) {
+			session.target_entries[group] = paks.Index().Find(key);
+		}
+		//Diffs name their targets in file name order, which is effectively random within an archive. Every target is known by now, so
+		//the archives are read ahead in the order the targets are stored in, before the first one is parsed.
+		if (const szt ranges{ paks.Schedule(session.target_entries) }; ranges > 0u) {
+			logger.Info("Reading {} targets ahead as {} sequential ranges"sv, session.groups.size(), ranges);
+		}
+
+		//Workers claim targets in order and stop claiming after the first failure. Results keep their target's slot, so parsed ends up in
+		//the same order whatever the worker count.
+		//A lone worker would also inflate every target by itself, so instead each window of upcoming targets is inflated on the thread pool,
+		//one per thread, before the worker parses them from memory. Several workers already inflate their own targets in parallel.
+		const szt workers{ std::min(parse_workers == 0u ? ThreadPool::GetSingleton().Size() + 1u : parse_workers, session.groups.size()) };
+		const szt window{ workers == 1u ? ThreadPool::GetSingleton().Size() + 1u : 1u };
+		vector<std::optional<std::pair<string, string>>> results(session.groups.size());
+		std::atomic<szt> next{ 0u };
+		std::atomic<bool> cancelled{ false };
+		const ThreadPool::Job work{ [&](szt) -> bool {
+			if (cancelled.load()) {
 				return false;
 			}
-			if (!parser.SetTarget(target_entry.readAsText())) {
-				logger.Error("Failed to set target <{}>. Parse aborted."sv, path_of_target);
-				parsed.clear();
-				freePaks();
-				return false;
+			StringParser::Parser parser{};
+			parser.SetParallelMerge(parallel_merge);
+			parser.SetLazyTarget(lazy_targets);
+			for (szt group{ next.fetch_add(1u) }; group < session.groups.size() && !cancelled.load(); group = next.fetch_add(1u)) {
+				if (window > 1u && group % window == 0u) {
+					PrefetchTargets(group, window, session);
+				}
+				if (!ParseGroup(group, session, parser, results[group])) {
+					cancelled.store(true);
+					return false;
+				}
 			}
+			file_copies.fetch_add(parser.GetFileCopies());
+			return !cancelled.load();
+		} };
+		if (!(workers > 1u ? ThreadPool::GetSingleton().Run(workers, work) : work(0u))) {
+			parsed.clear();
+			return false;
+		}
 
-			//Parse and store parse data to parsed
-			std::pair<string, string> diff_data{ path_of_target, "" };
-			if (!parser.Parse(diff_data.second)) {
-				logger.Error("Failed to parse <{}>. Parse aborted."sv, diff.string());
-				parsed.clear();
-				freePaks();
-				return false;
+		for (auto& result : results) {
+			if (result) {
+				parsed.push_back(std::move(*result));
 			}
-			parsed.push_back(std::move(diff_data));
 		}
-
-		freePaks();
+		if (workers > 1u) {
+			logger.Info("Parsed {} targets on {} workers"sv, session.groups.size(), workers);
+		}
+		if (session.prefetched > 0u) {
+			logger.Info("Inflated {} targets on {} threads ahead of the parser"sv, session.prefetched, window);
+		}
+		//Targets read ahead were each read into a buffer of their own, like the one the parser streams the others into
+		logger.Info("Made {} whole-file copies of {} diffs and {} targets"sv, file_copies.load() + session.prefetched, diffs.size(), session.groups.size());
 		return true;
 	}
 	catch (...) {
@@ -250,6 +296,86 @@ bool FileManager::JustParse() noexcept {
 	}
 }
 
+//Applies every diff of session.groups[group] to its target. out is left empty if the diffs make no changes.
+[[nodiscard]] bool FileManager::ParseGroup(szt group, ParseSession& session, StringParser::Parser& parser, std::optional<std::pair<string, string>>& out) const {
+	const vector<szt>& members{ session.groups[group] };
+	const path& diff{ diffs[members.front()] };
+	auto isProgram = [&](szt i) { return StringParser::PatchProgram::IsProgram(session.programs[i].View()); };
+	//Text diffs are moved into the parser, which preprocesses them in place
+	if (!(isProgram(members.front()) ? parser.SetDiffProgram(session.programs[members.front()].View()) : parser.SetDiff(std::move(session.diff_strs[members.front()])))) {
+		logger.Error("Failed to set diff <{}>. Parse aborted."sv, diff.string());
+		return false;
+	}
+	for (auto other{ std::next(members.cbegin()) }; other != members.cend(); ++other) {
+		if (!(isProgram(*other) ? parser.AddDiffProgram(session.programs[*other].View()) : parser.AddDiff(std::move(session.diff_strs[*other])))) {
+			logger.Error("Failed to add diff <{}> to <{}>, which targets the same file. Parse aborted."sv, diffs[*other].string(), diff.string());
+			return false;
+		}
+	}
+
+	//Get and set target file string
+	const string path_of_target{ parser.GetTargetPath() };
+	if (members.size() > 1u) {
+		logger.Info("Applying {} diffs to <{}> in one pass"sv, members.size(), path_of_target);
+	}
+	const PakIndex::Entry* indexed{ paks.Index().Find(path_of_target) };
+	if (!indexed) {
+		logger.Error("Failed to locate target <{}> requested in diff <{}>. Parse aborted."sv, path_of_target, diff.string());
+		return false;
+	}
+	//A target that wasn't inflated ahead is streamed instead. Each chunk is preprocessed as soon as it is inflated, so the entry is never
+	//held in one more buffer than the parser keeps.
+	std::optional<string>& prefetched{ session.target_texts[group] };
+	if (!(prefetched && indexed == session.target_entries[group] ? parser.SetTarget(std::move(*prefetched))
+		: parser.StreamTarget(indexed->size, [&](const PakSession::ChunkSink& sink) { return paks.Read(*indexed, sink); }))) {
+		logger.Error("Failed to set target <{}>. Parse aborted."sv, path_of_target);
+		return false;
+	}
+
+	//Skip diffs that only restate their target, e.g. after the game adopted the change in an official patch
+	if (!parser.HasNetChanges()) {
+		logger.Info("Diff <{}> makes no changes to <{}>. Skipped."sv, diff.string(), path_of_target);
+		return true;
+	}
+
+	//Parse and store parse data to out
+	std::pair<string, string> diff_data{ path_of_target, "" };
+	if (!parser.Parse(diff_data.second)) {
+		logger.Error("Failed to parse <{}>. Parse aborted."sv, diff.string());
+		return false;
+	}
+#ifdef _WIN32
+	//Parsed files used to reach the archive through a text mode temporary file, so they keep the "\r\n" line endings it wrote
+	StringUtils::ExpandLF(diff_data.second);
+#endif
+	out = std::move(diff_data);
+	return true;
+}
+
+//Inflates the targets of groups [first, first + count) at once, for a worker that parses them in order
+void FileManager::PrefetchTargets(szt first, szt count, ParseSession& session) const {
+	const szt last{ std::min(first + count, session.groups.size()) };
+	const vector<const PakIndex::Entry*> entries(session.target_entries.cbegin() + first, session.target_entries.cbegin() + last);
+	vector<std::optional<string>> texts{};
+	session.prefetched += paks.ReadAll(entries, texts);
+	for (szt i{ 0u }; i < texts.size(); ++i) {
+		session.target_texts[first + i] = std::move(texts[i]); //Targets that failed are left to ParseGroup(), which reports them in order
+	}
+}
+
+//Maps a diff file. A compiled patch program stays mapped in program and is used in place. A text diff is copied to text once, with its
+//line endings normalized, since the parser preprocesses it in place, and the mapping is closed.
+[[nodiscard]] bool FileManager::ReadDiff(const path& file, MappedFile& program, string& text) {
+	if (!program.Open(file)) {
+		return false;
+	}
+	if (!StringParser::PatchProgram::IsProgram(program.View())) {
+		text = program.Text();
+		program.Close();
+	}
+	return true;
+}
+
 vector<path>& FileManager::GetPathVec(bool diff) noexcept  { return (diff ? diffs : targets); }
 
 bool FileManager::SetPath(const string& str, bool diff) noexcept {
@@ -275,6 +401,7 @@ bool FileManager::SetPath(const string& str, bool diff) noexcept {
 					diffs.push_back(dirEntry.path());
 				}
 			}
+			std::sort(diffs.begin(), diffs.end()); //Diffs sharing a target apply in this order
 			if (!diffs.empty()) {
 				logger.Info("Path <{}> contains {} (diff?) files!"sv, str, diffs.size());
 				return true;
@@ -286,11 +413,13 @@ bool FileManager::SetPath(const string& str, bool diff) noexcept {
 		}
 		else {
 			targets.clear();
+			paks.Close();
 			for (const auto& dirEntry : directory_iterator{ newpath }) {
 				if (dirEntry.is_regular_file() && dirEntry.path().extension() == ".pak") {
 					targets.push_back(dirEntry.path());
 				}
 			}
+			std::sort(targets.begin(), targets.end()); //Entries in several archives resolve to the first, see PakIndex
 			if (!targets.empty()) {
 				logger.Info("Path <{}> contains {} .pak files!"sv, str, targets.size());
 				return true;
@@ -1,10 +1,15 @@
 #pragma once
 #include "Common.h"
+#include "PakSession.h"
 
 #include <filesystem>
+#include <optional>
 
 using namespace std::filesystem;
 
+namespace StringParser { class Parser; }
+class MappedFile;
+
 class FileManager {
 public:
 
@@ -16,6 +21,11 @@ public:
 	bool ParseAndCommit() noexcept;
 
 	void ToFiles() noexcept;
+	bool CompileDiffs(const string& out_dir) noexcept;	//Writes each diff as a patch program, which loads without any text processing when used as a diff
+
+	void SetParallelMerge(bool enable) noexcept;
+	void SetLazyTargets(bool enable) noexcept;
+	void SetParseWorkers(szt count) noexcept;	//Targets parsed at once. 0 uses one per hardware thread.
 
 	void Reset() noexcept;
 
@@ -23,11 +33,20 @@ private:
 	vector<path> diffs{};
 	vector<path> targets{};
 	vector<std::pair<string, string>> parsed{};
+	PakSession paks{};				//Archives in targets. Opened by JustParse() and kept open for Commit().
+	bool parallel_merge{ false };	//Let the parser merge top level nodes of a file on the thread pool
+	bool lazy_targets{ false };		//Only generate the target scopes each diff reaches
+	szt parse_workers{ 1u };		//Each worker has its own parser and takes the next unparsed target until none are left
+
+	struct ParseSession;
 
 	vector<path>& GetPathVec(bool diff) noexcept;
 	bool SetPath(const string& str, bool diff) noexcept;
 
 	bool JustParse() noexcept;
+	[[nodiscard]] bool ParseGroup(szt group, ParseSession& session, StringParser::Parser& parser, std::optional<std::pair<string, string>>& out) const;
+	void PrefetchTargets(szt first, szt count, ParseSession& session) const;
+	[[nodiscard]] static bool ReadDiff(const path& file, MappedFile& program, string& text);
 	
 
 };
@@ -122,6 +122,7 @@ namespace Logging {
 		try {
 			string prefixed = GetPrefix(severity) + newmsg;
 			if (target.load(std::memory_order_relaxed) & file) {
+				Locker locker(lock); //Messages can come from worker threads
 				filestream << prefixed << '\n';
 			}
 			if (target.load(std::memory_order_relaxed) & queue) {
@@ -0,0 +1,175 @@
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+//	MappedFile public
+
+MappedFile::~MappedFile() noexcept { Close(); }
+
+MappedFile::MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		Close();
+		const bool mapped{ other.IsMapped() };
+		buffer = std::move(other.buffer);
+		data = (mapped ? other.data : buffer.data());
+		size = other.size;
+#ifdef _WIN32
+		file_handle = std::exchange(other.file_handle, nullptr);
+		mapping_handle = std::exchange(other.mapping_handle, nullptr);
+#endif
+		other.data = nullptr;
+		other.size = 0u;
+		other.buffer.clear();
+	}
+	return *this;
+}
+
+[[nodiscard]] bool MappedFile::Open(const std::filesystem::path& file) noexcept {
+	Close();
+	return Map(file) || ReadIntoBuffer(file);
+}
+
+[[nodiscard]] string_view MappedFile::View() const noexcept { return (data ? string_view{ data, size } : string_view{}); }
+
+[[nodiscard]] string MappedFile::Text() const {
+	const string_view view{ View() };
+	string out{};
+	out.reserve(view.size());
+	szt begin{ 0u };
+	for (szt cr{ view.find('\r') }; cr != string_view::npos; cr = view.find('\r', cr + 1u)) {
+		if (cr + 1u < view.size() && view[cr + 1u] == '\n') {
+			out.append(view.substr(begin, cr - begin));
+			begin = cr + 1u;
+		}
+	}
+	out.append(view.substr(begin));
+	return out;
+}
+
+[[nodiscard]] bool MappedFile::IsMapped() const noexcept { return data != nullptr && data != buffer.data(); }
+
+void MappedFile::WillNeed(szt offset, szt length) const noexcept {
+	if (!IsMapped() || offset >= size) {
+		return;
+	}
+	length = std::min(length, size - offset);
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range{ const_cast<char*>(data + offset), length };
+	(void)PrefetchVirtualMemory(GetCurrentProcess(), 1u, &range, 0u);
+#else
+	static const szt page{ static_cast<szt>(sysconf(_SC_PAGESIZE)) };
+	const szt begin{ offset - offset % page }; //The mapping itself starts on a page
+	(void)madvise(const_cast<char*>(data + begin), length + (offset - begin), MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::Close() noexcept {
+	if (IsMapped()) {
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap(const_cast<char*>(data), size);
+#endif
+	}
+#ifdef _WIN32
+	if (mapping_handle) {
+		CloseHandle(mapping_handle);
+	}
+	if (file_handle) {
+		CloseHandle(file_handle);
+	}
+	file_handle = nullptr;
+	mapping_handle = nullptr;
+#endif
+	data = nullptr;
+	size = 0u;
+	buffer.clear();
+}
+
+
+
+//	MappedFile private
+
+//Only regular, non empty files are mapped. Mapping an empty file fails on both platforms.
+[[nodiscard]] bool MappedFile::Map(const std::filesystem::path& file) noexcept {
+	std::error_code ec{};
+	if (!std::filesystem::is_regular_file(file, ec)) {
+		return false;
+	}
+#ifdef _WIN32
+	HANDLE handle{ CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER file_size{};
+	if (!GetFileSizeEx(handle, &file_size) || file_size.QuadPart <= 0) {
+		CloseHandle(handle);
+		return false;
+	}
+	HANDLE mapping{ CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+	if (!mapping) {
+		CloseHandle(handle);
+		return false;
+	}
+	const void* view{ MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) };
+	if (!view) {
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		return false;
+	}
+	file_handle = handle;
+	mapping_handle = mapping;
+	data = static_cast<const char*>(view);
+	size = static_cast<szt>(file_size.QuadPart);
+#else
+	const int fd{ ::open(file.c_str(), O_RDONLY) };
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st{};
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+		::close(fd);
+		return false;
+	}
+	void* view{ mmap(nullptr, static_cast<szt>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0) };
+	::close(fd); //The mapping keeps its own reference to the file
+	if (view == MAP_FAILED) {
+		return false;
+	}
+	data = static_cast<const char*>(view);
+	size = static_cast<szt>(st.st_size);
+#endif
+	return true;
+}
+
+[[nodiscard]] bool MappedFile::ReadIntoBuffer(const std::filesystem::path& file) noexcept {
+	try {
+		std::ifstream ifs{ file, std::ios::binary };
+		if (!ifs.is_open()) {
+			return false;
+		}
+		buffer.assign(std::istreambuf_iterator<char>{ ifs }, std::istreambuf_iterator<char>{});
+		data = buffer.data();
+		size = buffer.size();
+		return true;
+	}
+	catch (...) {
+		buffer.clear();
+		return false;
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "Common.h"
+
+#include <filesystem>
+
+
+//Read only view of a whole file. Regular files are memory mapped, so their bytes are never copied into a heap buffer. Anything that can't be
+//mapped, like an empty or special file, is read into an owned buffer instead and viewed the same way.
+class MappedFile {
+public:
+	MappedFile() noexcept = default;
+	~MappedFile() noexcept;
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	[[nodiscard]] bool Open(const std::filesystem::path& file) noexcept;
+	[[nodiscard]] string_view View() const noexcept;	//Valid until Close() or the object is destroyed
+	[[nodiscard]] string Text() const;					//Copy of View() with "\r\n" read as '\n', like a file opened in text mode on Windows
+	[[nodiscard]] bool IsMapped() const noexcept;		//False if the file was read into a buffer instead
+	void WillNeed(szt offset, szt length) const noexcept;	//Hints that the range is read soon, so the system reads it ahead in one go. Does nothing for buffered files.
+	void Close() noexcept;
+
+private:
+	const char* data{ nullptr };
+	szt size{ 0u };
+	string buffer{};			//Fallback for files that aren't mapped
+#ifdef _WIN32
+	void* file_handle{ nullptr };
+	void* mapping_handle{ nullptr };
+#endif
+
+	[[nodiscard]] bool Map(const std::filesystem::path& file) noexcept;
+	[[nodiscard]] bool ReadIntoBuffer(const std::filesystem::path& file) noexcept;
+};
@@ -0,0 +1,58 @@
+#include "PakIndex.h"
+#include "logger.h"
+
+#include "PakReader.h"
+
+#include <cctype>
+
+
+//	PakIndex public
+
+[[nodiscard]] bool PakIndex::AddArchive(const PakReader& pak) noexcept {
+	try {
+		const auto& pak_entries{ pak.Entries() };
+		for (szt i{ 0u }; i < pak_entries.size(); ++i) {
+			if (!pak_entries[i].IsFile()) {
+				continue;
+			}
+			Entry entry{ archives, i, pak_entries[i].size, pak_entries[i].crc, pak_entries[i].name };
+			if (!entries.try_emplace(Normalize(entry.name), std::move(entry)).second) {
+				++shadowed;
+			}
+		}
+		++archives;
+		return true;
+	}
+	catch (...) {
+		logger.Error("Unspecified exception while indexing .pak file <{}>"sv, pak.GetPath().string());
+		return false;
+	}
+}
+
+[[nodiscard]] const PakIndex::Entry* PakIndex::Find(string_view name) const noexcept {
+	try {
+		auto it{ entries.find(Normalize(name)) };
+		return it != entries.end() ? &it->second : nullptr;
+	}
+	catch (...) {
+		return nullptr;
+	}
+}
+
+[[nodiscard]] bool PakIndex::Empty() const noexcept { return entries.empty(); }
+[[nodiscard]] szt PakIndex::Size() const noexcept { return entries.size(); }
+[[nodiscard]] szt PakIndex::Shadowed() const noexcept { return shadowed; }
+
+void PakIndex::Clear() noexcept {
+	entries.clear();
+	archives = 0u;
+	shadowed = 0u;
+}
+
+[[nodiscard]] string PakIndex::Normalize(string_view name) {
+	string out{ name };
+	for (auto& c : out) {
+		c = (c == '\\' ? '/' : static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+	}
+	return out;
+}
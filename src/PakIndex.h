@@ -0,0 +1,39 @@
+#pragma once
+#include "Common.h"
+
+#include <unordered_map>
+
+class PakReader;
+
+//Every entry of a set of .pak archives, read once from their central directories and looked up by name without touching the archives again.
+//Names are matched case insensitively and with either kind of slash, like the game does.
+//
+//Precedence: an entry that appears in several archives resolves to the archive that was added first, which is file name order for
+//FileManager. Within one archive the entry with the lowest index wins.
+class PakIndex {
+public:
+	struct Entry final {
+	public:
+		uint32 archive{ 0u };	//Number of archives added before this entry's
+		uint64 index{ 0u };		//Entry index within its archive, see PakReader::Entries()
+		uint64 size{ 0u };		//Uncompressed
+		uint32 crc{ 0u };
+		string name{};			//As stored in the archive
+	};
+
+	[[nodiscard]] bool AddArchive(const PakReader& pak) noexcept;	//pak must be open
+	[[nodiscard]] const Entry* Find(string_view name) const noexcept;	//nullptr if no archive has it
+
+	[[nodiscard]] bool Empty() const noexcept;
+	[[nodiscard]] szt Size() const noexcept;
+	[[nodiscard]] szt Shadowed() const noexcept;	//Entries hidden by an entry of the same name that takes precedence
+
+	void Clear() noexcept;
+
+	[[nodiscard]] static string Normalize(string_view name);
+
+private:
+	std::unordered_map<string, Entry> entries{};	//Normalized name to entry
+	uint32 archives{ 0u };
+	szt shadowed{ 0u };
+};
@@ -0,0 +1,367 @@
+#include "PakReader.h"
+#include "logger.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <limits>
+
+
+namespace {
+
+	//Record signatures and fixed sizes, from the zip application note
+	constexpr uint32 LOCAL_HEADER_SIG{ 0x04034b50u };
+	constexpr uint32 CENTRAL_HEADER_SIG{ 0x02014b50u };
+	constexpr uint32 EOCD_SIG{ 0x06054b50u };
+	constexpr uint32 ZIP64_EOCD_SIG{ 0x06064b50u };
+	constexpr uint32 ZIP64_LOCATOR_SIG{ 0x07064b50u };
+	constexpr uint32 ZIP64_EXTRA_ID{ 0x0001u };
+	constexpr szt LOCAL_HEADER_SIZE{ 30u };
+	constexpr szt CENTRAL_HEADER_SIZE{ 46u };
+	constexpr szt EOCD_SIZE{ 22u };
+	constexpr szt ZIP64_EOCD_SIZE{ 56u };
+	constexpr szt ZIP64_LOCATOR_SIZE{ 20u };
+	constexpr szt MAX_COMMENT{ 0xFFFFu };
+	constexpr uint32 MAX_16{ 0xFFFFu };
+	constexpr uint32 MAX_32{ 0xFFFFFFFFu };
+	constexpr uint32 ENCRYPTED_FLAG{ 1u };
+	constexpr uint64 MAX_DEFLATE_RATIO{ 1032u };
+
+	//Little endian fields. Callers check bounds first.
+	[[nodiscard]] uint64 Get(string_view data, uint64 offset, szt bytes) noexcept {
+		uint64 value{ 0u };
+		for (szt i{ 0u }; i < bytes; ++i) {
+			value |= uint64{ static_cast<uint8>(data[static_cast<szt>(offset) + i]) } << (8u * i);
+		}
+		return value;
+	}
+	[[nodiscard]] uint32 Get16(string_view data, uint64 offset) noexcept { return static_cast<uint32>(Get(data, offset, 2u)); }
+	[[nodiscard]] uint32 Get32(string_view data, uint64 offset) noexcept { return static_cast<uint32>(Get(data, offset, 4u)); }
+	[[nodiscard]] uint64 Get64(string_view data, uint64 offset) noexcept { return Get(data, offset, 8u); }
+
+	[[nodiscard]] bool InBounds(string_view data, uint64 offset, uint64 length) noexcept { return offset <= data.size() && length <= data.size() - offset; }
+
+	//Frees zlib's state on every way out of Inflate()
+	struct InflateStream final {
+	public:
+		z_stream stream{};
+		bool initialized{ false };
+
+		~InflateStream() noexcept {
+			if (initialized) {
+				inflateEnd(&stream);
+			}
+		}
+	};
+
+}
+
+
+
+//	PakReader::Entry
+
+[[nodiscard]] bool PakReader::Entry::IsFile() const noexcept { return !name.empty() && name.back() != '/' && name.back() != '\\'; }
+
+
+
+//	PakReader public
+
+[[nodiscard]] bool PakReader::Open(const std::filesystem::path& file_path) noexcept {
+	Close();
+	try {
+		path = file_path;
+		if (!file.Open(file_path)) {
+			logger.Error("Failed to open .pak file <{}>"sv, file_path.string());
+			Close();
+			return false;
+		}
+		if (!ReadCentralDirectory(file.View())) {
+			Close();
+			return false;
+		}
+		return true;
+	}
+	catch (...) {
+		logger.Error("Unspecified exception while opening .pak file <{}>"sv, file_path.string());
+		Close();
+		return false;
+	}
+}
+
+[[nodiscard]] bool PakReader::IsOpen() const noexcept { return !path.empty(); }
+[[nodiscard]] const std::filesystem::path& PakReader::GetPath() const noexcept { return path; }
+[[nodiscard]] const vector<PakReader::Entry>& PakReader::Entries() const noexcept { return entries; }
+
+void PakReader::Close() noexcept {
+	file.Close();
+	path.clear();
+	entries.clear();
+}
+
+[[nodiscard]] bool PakReader::View(szt index, string_view& out) const noexcept {
+	if (index >= entries.size() || entries[index].method != Stored || (entries[index].flags & ENCRYPTED_FLAG) != 0u) {
+		return false;
+	}
+	return ReadData(index, out) && out.size() == entries[index].size;
+}
+
+[[nodiscard]] bool PakReader::Read(szt index, char* buffer, szt buffer_size, const ChunkSink& sink) const noexcept {
+	try {
+		if (index >= entries.size()) {
+			return false;
+		}
+		const Entry& entry{ entries[index] };
+		if ((entry.flags & ENCRYPTED_FLAG) != 0u) {
+			logger.Error("<{}> in <{}> is encrypted"sv, entry.name, path.string());
+			return false;
+		}
+		string_view data{};
+		if (!ReadData(index, data)) {
+			return false;
+		}
+		switch (entry.method) {
+		case Stored:
+			if (data.size() != entry.size || crc32_z(0uL, reinterpret_cast<const Bytef*>(data.data()), data.size()) != entry.crc) {
+				logger.Error("<{}> in <{}> is corrupt"sv, entry.name, path.string());
+				return false;
+			}
+			return data.empty() || sink(data);
+		case Deflated:
+			return Inflate(entry, data, buffer, buffer_size, sink);
+		default:
+			logger.Error("<{}> in <{}> uses compression method {}, which isn't supported"sv, entry.name, path.string(), entry.method);
+			return false;
+		}
+	}
+	catch (...) {
+		logger.Error("Unspecified exception while reading .pak file <{}>"sv, path.string());
+		return false;
+	}
+}
+
+[[nodiscard]] bool PakReader::Read(szt index, string& out) const noexcept {
+	try {
+		out.clear();
+		if (index >= entries.size()) {
+			return false;
+		}
+		const Entry& entry{ entries[index] };
+		//Sizes come from the central directory, so they're checked against the data that is actually there before anything is allocated.
+		//Stored data is the entry itself, and deflate can't expand data more than 1032 times.
+		string_view data{};
+		if (!ReadData(index, data)) {
+			return false;
+		}
+		if (entry.method == Stored ? data.size() != entry.size : entry.size / MAX_DEFLATE_RATIO > data.size()) {
+			logger.Error("<{}> in <{}> is corrupt"sv, entry.name, path.string());
+			return false;
+		}
+		//Deflated entries are inflated straight into out. Stored ones arrive as a view of the mapping and are copied.
+		out.resize(static_cast<szt>(entry.size));
+		szt filled{ 0u };
+		char empty{};
+		const auto fill = [&](string_view chunk) {
+			if (chunk.size() > out.size() - filled) {
+				return false;
+			}
+			if (chunk.data() != out.data() + filled) {
+				std::copy(chunk.cbegin(), chunk.cend(), out.begin() + static_cast<std::ptrdiff_t>(filled));
+			}
+			filled += chunk.size();
+			return true;
+		};
+		if (!Read(index, out.empty() ? &empty : out.data(), std::max<szt>(out.size(), 1u), fill) || filled != out.size()) {
+			out.clear();
+			return false;
+		}
+		return true;
+	}
+	catch (...) {
+		out.clear();
+		return false;
+	}
+}
+
+
+
+[[nodiscard]] std::pair<uint64, uint64> PakReader::Extent(szt index) const noexcept {
+	if (index >= entries.size()) {
+		return { 0u, 0u };
+	}
+	const Entry& entry{ entries[index] };
+	return { entry.header_offset, entry.header_offset + LOCAL_HEADER_SIZE + entry.name.size() + entry.compressed_size };
+}
+
+void PakReader::WillNeed(uint64 begin, uint64 end) const noexcept {
+	if (begin < end && begin < file.View().size()) {
+		file.WillNeed(static_cast<szt>(begin), static_cast<szt>(std::min<uint64>(end - begin, file.View().size() - begin)));
+	}
+}
+
+
+
+//	PakReader private
+
+[[nodiscard]] bool PakReader::ReadCentralDirectory(string_view pak) {
+	if (pak.size() < EOCD_SIZE) {
+		logger.Error("<{}> is not a .pak file"sv, path.string());
+		return false;
+	}
+	//The end of central directory record is followed by a comment of up to 64 KiB, so it's searched for backwards. The comment's length has
+	//to reach the end of the file exactly, which skips signatures that are part of the comment.
+	szt eocd{ pak.size() - EOCD_SIZE };
+	const szt lowest{ eocd > MAX_COMMENT ? eocd - MAX_COMMENT : 0u };
+	while (Get32(pak, eocd) != EOCD_SIG || eocd + EOCD_SIZE + Get16(pak, eocd + 20u) != pak.size()) {
+		if (eocd == lowest) {
+			logger.Error("<{}> has no end of central directory record"sv, path.string());
+			return false;
+		}
+		--eocd;
+	}
+
+	uint64 count{ Get16(pak, eocd + 10u) };
+	uint64 directory_size{ Get32(pak, eocd + 12u) };
+	uint64 directory_offset{ Get32(pak, eocd + 16u) };
+	if ((count == MAX_16 || directory_size == MAX_32 || directory_offset == MAX_32) && eocd >= ZIP64_LOCATOR_SIZE && Get32(pak, eocd - ZIP64_LOCATOR_SIZE) == ZIP64_LOCATOR_SIG) {
+		const uint64 zip64_eocd{ Get64(pak, eocd - ZIP64_LOCATOR_SIZE + 8u) };
+		if (!InBounds(pak, zip64_eocd, ZIP64_EOCD_SIZE) || Get32(pak, zip64_eocd) != ZIP64_EOCD_SIG) {
+			logger.Error("<{}> has a corrupt zip64 end of central directory record"sv, path.string());
+			return false;
+		}
+		count = Get64(pak, zip64_eocd + 32u);
+		directory_size = Get64(pak, zip64_eocd + 40u);
+		directory_offset = Get64(pak, zip64_eocd + 48u);
+	}
+	if (!InBounds(pak, directory_offset, directory_size)) {
+		logger.Error("<{}> has a central directory past the end of the file"sv, path.string());
+		return false;
+	}
+
+	const string_view directory{ pak.substr(static_cast<szt>(directory_offset), static_cast<szt>(directory_size)) };
+	entries.reserve(static_cast<szt>(std::min<uint64>(count, directory.size() / CENTRAL_HEADER_SIZE))); //count alone can't be trusted
+	uint64 pos{ 0u };
+	for (uint64 i{ 0u }; i < count; ++i) {
+		if (!InBounds(directory, pos, CENTRAL_HEADER_SIZE) || Get32(directory, pos) != CENTRAL_HEADER_SIG) {
+			logger.Error("<{}> has a corrupt central directory entry {}"sv, path.string(), i);
+			return false;
+		}
+		const uint32 name_length{ Get16(directory, pos + 28u) }, extra_length{ Get16(directory, pos + 30u) }, comment_length{ Get16(directory, pos + 32u) };
+		if (!InBounds(directory, pos + CENTRAL_HEADER_SIZE, uint64{ name_length } + extra_length + comment_length)) {
+			logger.Error("<{}> has a corrupt central directory entry {}"sv, path.string(), i);
+			return false;
+		}
+		Entry entry{};
+		entry.flags = Get16(directory, pos + 8u);
+		entry.method = Get16(directory, pos + 10u);
+		entry.crc = Get32(directory, pos + 16u);
+		entry.compressed_size = Get32(directory, pos + 20u);
+		entry.size = Get32(directory, pos + 24u);
+		entry.header_offset = Get32(directory, pos + 42u);
+		entry.name = directory.substr(static_cast<szt>(pos + CENTRAL_HEADER_SIZE), name_length);
+
+		//Zip64 extra field holds the real value of each field above that is saturated, in this order
+		if (entry.size == MAX_32 || entry.compressed_size == MAX_32 || entry.header_offset == MAX_32) {
+			const string_view extra{ directory.substr(static_cast<szt>(pos + CENTRAL_HEADER_SIZE + name_length), extra_length) };
+			for (szt field{ 0u }; field + 4u <= extra.size();) {
+				const uint32 id{ Get16(extra, field) }, length{ Get16(extra, field + 2u) };
+				if (!InBounds(extra, field + 4u, length)) {
+					break;
+				}
+				if (id == ZIP64_EXTRA_ID) {
+					szt value{ field + 4u };
+					const szt end{ value + length };
+					for (uint64* saturated : { &entry.size, &entry.compressed_size, &entry.header_offset }) {
+						if (*saturated == MAX_32 && value + 8u <= end) {
+							*saturated = Get64(extra, value);
+							value += 8u;
+						}
+					}
+					break;
+				}
+				field += 4u + length;
+			}
+		}
+		entries.push_back(std::move(entry));
+		pos += CENTRAL_HEADER_SIZE + name_length + extra_length + comment_length;
+	}
+	return true;
+}
+
+[[nodiscard]] bool PakReader::ReadData(szt index, string_view& out) const noexcept {
+	const Entry& entry{ entries[index] };
+	const string_view pak{ file.View() };
+	//The local header's name and extra field can differ in length from the central directory's, so the data offset is only known from it
+	if (!InBounds(pak, entry.header_offset, LOCAL_HEADER_SIZE) || Get32(pak, entry.header_offset) != LOCAL_HEADER_SIG) {
+		logger.Error("<{}> in <{}> has a corrupt local header"sv, entry.name, path.string());
+		return false;
+	}
+	const uint64 data_offset{ entry.header_offset + LOCAL_HEADER_SIZE + Get16(pak, entry.header_offset + 26u) + Get16(pak, entry.header_offset + 28u) };
+	if (!InBounds(pak, data_offset, entry.compressed_size)) {
+		logger.Error("<{}> in <{}> runs past the end of the file"sv, entry.name, path.string());
+		return false;
+	}
+	out = pak.substr(static_cast<szt>(data_offset), static_cast<szt>(entry.compressed_size));
+	return true;
+}
+
+[[nodiscard]] bool PakReader::Inflate(const Entry& entry, string_view data, char* buffer, szt buffer_size, const ChunkSink& sink) const noexcept {
+	if (buffer == nullptr || buffer_size == 0u) {
+		return false;
+	}
+	InflateStream inflater{};
+	if (inflateInit2(&inflater.stream, -MAX_WBITS) != Z_OK) { //Raw deflate, zip has no zlib header
+		logger.Error("Failed to start inflating <{}> from <{}>"sv, entry.name, path.string());
+		return false;
+	}
+	inflater.initialized = true;
+	z_stream& stream{ inflater.stream };
+	constexpr szt MAX_AVAIL{ std::numeric_limits<uInt>::max() };
+	char* const buffer_end{ buffer + buffer_size };
+	char* sent{ buffer };	//Output before this was already handed to sink
+
+	uint64 total{ 0u };
+	uLong crc{ crc32_z(0uL, Z_NULL, 0u) };
+	int result{ Z_OK };
+	while (result != Z_STREAM_END) {
+		if (stream.avail_in == 0u && !data.empty()) {
+			const szt feed{ std::min(data.size(), MAX_AVAIL) };
+			stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+			stream.avail_in = static_cast<uInt>(feed);
+			data.remove_prefix(feed);
+		}
+		//Output continues where it stopped and only starts over at the front once the buffer is full, so a buffer the size of the entry
+		//ends up holding all of it
+		if (stream.avail_out == 0u) {
+			if (sent == buffer_end) {
+				sent = buffer;
+			}
+			stream.next_out = reinterpret_cast<Bytef*>(sent);
+			stream.avail_out = static_cast<uInt>(std::min(static_cast<szt>(buffer_end - sent), MAX_AVAIL));
+		}
+		result = inflate(&stream, Z_NO_FLUSH);
+		if (result != Z_OK && result != Z_STREAM_END) {
+			logger.Error("<{}> in <{}> is corrupt"sv, entry.name, path.string());
+			return false;
+		}
+		const szt produced{ static_cast<szt>(reinterpret_cast<char*>(stream.next_out) - sent) };
+		if (produced > 0u) {
+			total += produced;
+			if (total > entry.size) {
+				break;
+			}
+			crc = crc32_z(crc, reinterpret_cast<const Bytef*>(sent), produced);
+			if (!sink(string_view{ sent, produced })) {
+				return false;
+			}
+			sent += produced;
+		}
+		else if (result == Z_OK && stream.avail_in == 0u && data.empty()) { //Out of input before the end of the stream
+			break;
+		}
+	}
+	if (result != Z_STREAM_END || total != entry.size || crc != entry.crc) {
+		logger.Error("<{}> in <{}> is corrupt"sv, entry.name, path.string());
+		return false;
+	}
+	return true;
+}
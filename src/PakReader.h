@@ -0,0 +1,65 @@
+#pragma once
+#include "Common.h"
+#include "MappedFile.h"
+
+#include <filesystem>
+#include <functional>
+#include <utility>
+
+
+//Read only .pak (zip) archive over a mapped file. The end of central directory and central directory records are parsed in place, stored
+//entries are handed out as views of the mapping and deflated entries are inflated with zlib into a buffer the caller owns. Zip64 archives
+//are supported. Encrypted entries and compression methods other than stored and deflate are not.
+//
+//Nothing changes after Open(), so any number of threads may read from one reader at once.
+class PakReader {
+public:
+	using ChunkSink = std::function<bool(string_view)>;
+
+	enum Method : uint32 {
+		Stored = 0u,
+		Deflated = 8u
+	};
+
+	struct Entry final {
+	public:
+		string name{};
+		uint64 header_offset{ 0u };	//Of the local file header
+		uint64 compressed_size{ 0u };
+		uint64 size{ 0u };				//Uncompressed
+		uint32 crc{ 0u };
+		uint32 method{ Stored };
+		uint32 flags{ 0u };				//General purpose bit flags
+
+		[[nodiscard]] bool IsFile() const noexcept;	//Directories are stored as entries whose name ends with a slash
+	};
+
+	PakReader() noexcept = default;
+
+	PakReader(PakReader&&) noexcept = default;
+	PakReader& operator=(PakReader&&) noexcept = default;
+	PakReader(const PakReader&) = delete;
+	PakReader& operator=(const PakReader&) = delete;
+
+	[[nodiscard]] bool Open(const std::filesystem::path& file) noexcept;
+	[[nodiscard]] bool IsOpen() const noexcept;
+	[[nodiscard]] const std::filesystem::path& GetPath() const noexcept;
+	[[nodiscard]] const vector<Entry>& Entries() const noexcept;	//In central directory order
+	void Close() noexcept;
+
+	[[nodiscard]] bool View(szt index, string_view& out) const noexcept;	//Stored entries only. out is valid until Close().
+	[[nodiscard]] bool Read(szt index, char* buffer, szt buffer_size, const ChunkSink& sink) const noexcept;	//Stored entries go to sink in one view without touching buffer. Deflated ones are inflated into buffer, which is reused from the front once full.
+	[[nodiscard]] bool Read(szt index, string& out) const noexcept;	//Inflates into out without an intermediate buffer
+
+	[[nodiscard]] std::pair<uint64, uint64> Extent(szt index) const noexcept;	//[begin, end) of an entry's local header and data, from the central directory alone. Leaves out the local extra field.
+	void WillNeed(uint64 begin, uint64 end) const noexcept;	//Hints that the bytes in [begin, end) are read soon
+
+private:
+	MappedFile file{};
+	std::filesystem::path path{};
+	vector<Entry> entries{};
+
+	[[nodiscard]] bool ReadCentralDirectory(string_view pak);
+	[[nodiscard]] bool ReadData(szt index, string_view& out) const noexcept;	//Compressed bytes of an entry, checked against its local header
+	[[nodiscard]] bool Inflate(const Entry& entry, string_view data, char* buffer, szt buffer_size, const ChunkSink& sink) const noexcept;
+};
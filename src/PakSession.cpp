@@ -0,0 +1,209 @@
+#include "PakSession.h"
+#include "logger.h"
+#include "ThreadPool.h"
+
+#include "libzippp.h"
+
+#include <algorithm>
+#include <atomic>
+
+using namespace libzippp;
+
+
+//	PakSession::Archive
+
+class PakSession::Archive {
+public:
+	PakReader reader{};
+	std::unique_ptr<ZipArchive> writer{};	//Only for archives passed to OpenForWrite()
+};
+
+
+
+//	PakSession public
+
+PakSession::PakSession() noexcept = default;
+PakSession::~PakSession() noexcept { Close(); }
+
+[[nodiscard]] bool PakSession::Open(const vector<std::filesystem::path>& archive_paths) noexcept {
+	if (IsOpen() && paths == archive_paths) {
+		return true;
+	}
+	Close();
+	try {
+		archives.reserve(archive_paths.size());
+		for (const auto& file : archive_paths) {
+			auto archive{ std::make_unique<Archive>() };
+			if (!archive->reader.Open(file) || !index.AddArchive(archive->reader)) {
+				Close();
+				return false;
+			}
+			archives.push_back(std::move(archive));
+		}
+		paths = archive_paths;
+		if (index.Shadowed() > 0u) {
+			logger.Info("{} .pak entries are shadowed by an entry of the same name in an archive that comes first"sv, index.Shadowed());
+		}
+		return true;
+	}
+	catch (...) {
+		logger.Error("Unspecified exception while opening .pak files"sv);
+		Close();
+		return false;
+	}
+}
+
+[[nodiscard]] bool PakSession::IsOpen() const noexcept { return !archives.empty(); }
+[[nodiscard]] const PakIndex& PakSession::Index() const noexcept { return index; }
+
+[[nodiscard]] bool PakSession::Read(const PakIndex::Entry& entry, const ChunkSink& sink) const noexcept {
+	try {
+		if (entry.archive >= archives.size()) {
+			return false;
+		}
+		//The reader is immutable once open, so reads of one archive don't wait on each other. Each call inflates into its own buffer.
+		vector<char> buffer(CHUNK_SIZE);
+		if (!archives[entry.archive]->reader.Read(static_cast<szt>(entry.index), buffer.data(), buffer.size(), sink)) {
+			logger.Error("Failed to read <{}> from <{}>"sv, entry.name, paths[entry.archive].string());
+			return false;
+		}
+		return true;
+	}
+	catch (...) {
+		logger.Error("Unspecified exception while reading <{}> from .pak file"sv, entry.name);
+		return false;
+	}
+}
+
+[[nodiscard]] bool PakSession::Read(const PakIndex::Entry& entry, string& out) const noexcept {
+	if (entry.archive >= archives.size() || !archives[entry.archive]->reader.Read(static_cast<szt>(entry.index), out)) {
+		logger.Error("Failed to read <{}> from .pak file"sv, entry.name);
+		return false;
+	}
+	return true;
+}
+
+//Threads claim entries front to back through each archive, so together they read it mostly in one direction. Every entry still goes to its
+//own slot of out, so the results are the same whichever thread inflates what.
+szt PakSession::ReadAll(const vector<const PakIndex::Entry*>& entries, vector<std::optional<string>>& out) const noexcept {
+	try {
+		out.assign(entries.size(), std::nullopt);
+		const vector<szt> order{ ByOffset(entries) };
+		std::atomic<szt> read{ 0u };
+		const ThreadPool::Job job{ [&](szt i) -> bool {
+			if (string text{}; Read(*entries[order[i]], text)) {
+				out[order[i]] = std::move(text);
+				read.fetch_add(1u);
+			}
+			return true; //A failed entry doesn't stop the others
+		} };
+		(void)ThreadPool::GetSingleton().Run(order.size(), job);
+		return read.load();
+	}
+	catch (...) {
+		logger.Error("Unspecified exception while reading .pak entries"sv);
+		out.clear();
+		return 0u;
+	}
+}
+
+//Entries are merged into ranges in the order they sit in their archives and each range is hinted in that order, so a cold archive is read
+//front to back in a few long reads instead of a seek per entry, whatever order the entries are parsed in
+szt PakSession::Schedule(const vector<const PakIndex::Entry*>& entries) const noexcept {
+	try {
+		szt ranges{ 0u };
+		uint32 archive{ 0u };
+		std::pair<uint64, uint64> range{ 0u, 0u };
+		for (const szt i : ByOffset(entries)) {
+			const std::pair<uint64, uint64> extent{ archives[entries[i]->archive]->reader.Extent(static_cast<szt>(entries[i]->index)) };
+			if (ranges > 0u && entries[i]->archive == archive && extent.first <= range.second + MAX_GAP) {
+				range.second = std::max(range.second, extent.second);
+				continue;
+			}
+			if (ranges > 0u) {
+				archives[archive]->reader.WillNeed(range.first, range.second);
+			}
+			archive = entries[i]->archive;
+			range = extent;
+			++ranges;
+		}
+		if (ranges > 0u) {
+			archives[archive]->reader.WillNeed(range.first, range.second);
+		}
+		return ranges;
+	}
+	catch (...) {
+		return 0u; //Only hints, nothing to undo
+	}
+}
+
+//The mapping is dropped first since libzip replaces the file when it's closed, which Windows refuses while the file is mapped
+[[nodiscard]] bool PakSession::OpenForWrite(uint32 archive_num) noexcept {
+	try {
+		if (archive_num >= archives.size()) {
+			return false;
+		}
+		Archive& archive{ *archives[archive_num] };
+		if (archive.writer) {
+			return true;
+		}
+		archive.reader.Close();
+		auto writer{ std::make_unique<ZipArchive>(paths[archive_num].string()) };
+		writer->open(ZipArchive::Write);
+		if (!writer->isOpen()) {
+			logger.Error("Failed to open .pak file <{}> for writing"sv, paths[archive_num].string());
+			return false;
+		}
+		archive.writer = std::move(writer);
+		return true;
+	}
+	catch (...) {
+		logger.Error("Unspecified exception while opening .pak file for writing"sv);
+		return false;
+	}
+}
+
+[[nodiscard]] bool PakSession::AddData(const PakIndex::Entry& entry, const string& data) noexcept {
+	try {
+		if (entry.archive >= archives.size() || !archives[entry.archive]->writer) {
+			return false;
+		}
+		return archives[entry.archive]->writer->addData(entry.name, data.data(), data.size()); //Under the name it's stored as, replacing it
+	}
+	catch (...) {
+		return false;
+	}
+}
+
+bool PakSession::Close() noexcept {
+	bool closed{ true };
+	for (const auto& archive : archives) {
+		if (archive->writer && archive->writer->isOpen() && archive->writer->close() != LIBZIPPP_OK) {
+			logger.Warning("Archive <{}> was not closed successfully and changes to it might not go through."sv, archive->writer->getPath());
+			closed = false;
+		}
+	}
+	archives.clear();
+	paths.clear();
+	index.Clear();
+	return closed;
+}
+
+
+
+//	PakSession private
+
+[[nodiscard]] vector<szt> PakSession::ByOffset(const vector<const PakIndex::Entry*>& entries) const {
+	vector<szt> order{};
+	order.reserve(entries.size());
+	for (szt i{ 0u }; i < entries.size(); ++i) {
+		if (entries[i] && entries[i]->archive < archives.size()) {
+			order.push_back(i);
+		}
+	}
+	const auto position = [this](const PakIndex::Entry& entry) {
+		return std::make_pair(entry.archive, archives[entry.archive]->reader.Extent(static_cast<szt>(entry.index)).first);
+	};
+	std::sort(order.begin(), order.end(), [&](szt a, szt b) { return position(*entries[a]) < position(*entries[b]); });
+	return order;
+}
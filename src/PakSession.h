@@ -0,0 +1,50 @@
+#pragma once
+#include "Common.h"
+#include "PakIndex.h"
+#include "PakReader.h"
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+
+//The .pak archives of one parse and commit. Each archive is mapped and indexed once with PakReader, and stays open until Close(), so a
+//commit after a parse doesn't open and read every central directory again. Only archives that receive patched entries are reopened for
+//writing, through libzippp.
+//
+//Read() and ReadAll() may be called from several threads at once, and read any number of entries of one archive in parallel over its shared
+//mapping. Everything else must not overlap with any other call.
+class PakSession {
+public:
+	using ChunkSink = PakReader::ChunkSink;
+	static constexpr szt CHUNK_SIZE{ 64u * 1024u };	//Bytes inflated at a time by Read()
+	static constexpr uint64 MAX_GAP{ 1024u * 1024u };	//Entries closer than this are read ahead as one range. Reading through the gap costs less than a seek.
+
+	PakSession() noexcept;
+	~PakSession() noexcept;
+
+	PakSession(const PakSession&) = delete;
+	PakSession& operator=(const PakSession&) = delete;
+
+	[[nodiscard]] bool Open(const vector<std::filesystem::path>& archives) noexcept;	//Keeps the session if it's already open on the same archives
+	[[nodiscard]] bool IsOpen() const noexcept;
+	[[nodiscard]] const PakIndex& Index() const noexcept;
+
+	[[nodiscard]] bool Read(const PakIndex::Entry& entry, const ChunkSink& sink) const noexcept;	//Streams the entry to sink as it's inflated
+	[[nodiscard]] bool Read(const PakIndex::Entry& entry, string& out) const noexcept;
+	szt ReadAll(const vector<const PakIndex::Entry*>& entries, vector<std::optional<string>>& out) const noexcept;	//Inflates entries on the thread pool. out[i] is empty if entries[i] is nullptr or failed. Returns how many were read.
+	szt Schedule(const vector<const PakIndex::Entry*>& entries) const noexcept;	//Hints the system to read ahead every entry that is about to be read. Returns the number of ranges read ahead.
+	[[nodiscard]] bool OpenForWrite(uint32 archive) noexcept;
+	[[nodiscard]] bool AddData(const PakIndex::Entry& entry, const string& data) noexcept;	//data is read by Close() and must live until then
+
+	bool Close() noexcept;	//Writes added data. Returns false if any archive failed to close.
+
+private:
+	class Archive;
+
+	[[nodiscard]] vector<szt> ByOffset(const vector<const PakIndex::Entry*>& entries) const;	//Order of entries by archive, then position in it. nullptr entries are left out.
+
+	vector<std::unique_ptr<Archive>> archives{};
+	vector<std::filesystem::path> paths{};
+	PakIndex index{};
+};
@@ -0,0 +1,277 @@
+#include "PatchProgram.h"
+#include "logger.h"
+
+#include <algorithm>
+
+
+namespace StringParser {
+
+	using namespace MiscUtils;
+
+	using Node = PatchProgram::Node;
+	using Cache = PatchProgram::Cache;
+	using Flag = Node::Flag;
+	using NodeCIterator = Node::NodeCIterator;
+
+
+	//PatchProgram::Reader
+	class PatchProgram::Reader {
+	public:
+		Reader(string_view program_, Cache& dest_cache_) noexcept : program(program_), dest_cache(dest_cache_) {}
+
+		[[nodiscard]] bool ReadAll(vector<Node>& out) {
+			if (!ReadHeader() || !ReadStrings()) {
+				return false;
+			}
+			out.clear();
+			out.reserve(roots);
+			for (uint32 i{ 0u }; i < roots; ++i) {
+				Node node{};
+				if (!ReadNode(node, 0u) || !PushBackNoEx(out, std::move(node))) {
+					return false;
+				}
+			}
+			if (next != node_count) {
+				logger.Error("Patch program has {} nodes but its roots only hold {}"sv, node_count, next);
+				return false;
+			}
+			return true;
+		}
+
+	private:
+		static constexpr szt MAX_DEPTH{ 1024u };	//Far beyond any real diff. Keeps a corrupt program from exhausting the stack.
+
+		string_view program;
+		Cache& dest_cache;
+		vector<uint32> translation{};	//Program string ID to dest_cache ID
+		szt nodes_offset{ 0u };
+		uint32 node_count{ 0u };
+		uint32 roots{ 0u };
+		uint32 next{ 0u };				//Next node to read
+
+		[[nodiscard]] bool InBounds(uint64 offset, uint64 length) const noexcept { return offset <= program.size() && length <= program.size() - offset; }
+		[[nodiscard]] uint32 Header(PatchProgram::Field field) const noexcept { return Get(program.data() + field * sizeof(uint32)); }
+
+		[[nodiscard]] bool ReadHeader() noexcept {
+			if (!IsProgram(program) || program.size() < HEADER_SIZE) {
+				logger.Error("Not a patch program"sv);
+				return false;
+			}
+			if (Header(Version) != VERSION) {
+				logger.Error("Patch program version {} isn't supported. Compile the diff again for version {}."sv, Header(Version), VERSION);
+				return false;
+			}
+			nodes_offset = Header(NodesOffset);
+			node_count = Header(NodeCount);
+			roots = Header(RootCount);
+			if (!InBounds(Header(PathOffset), Header(PathLength)) || !InBounds(Header(StringsOffset), uint64{ Header(StringCount) } * STRING_SIZE)
+				|| !InBounds(nodes_offset, uint64{ node_count } * NODE_SIZE) || roots > node_count) {
+				logger.Error("Patch program is truncated or corrupt"sv);
+				return false;
+			}
+			return true;
+		}
+		[[nodiscard]] bool ReadStrings() {
+			const uint32 count{ Header(StringCount) };
+			translation.resize(count);
+			const char* entry{ program.data() + Header(StringsOffset) };
+			for (uint32 i{ 0u }; i < count; ++i, entry += STRING_SIZE) {
+				const uint32 offset{ Get(entry) }, length{ Get(entry + sizeof(uint32)) };
+				if (!InBounds(offset, length)) {
+					logger.Error("Patch program string {} is out of bounds"sv, i);
+					return false;
+				}
+				translation[i] = dest_cache.FindOrAdd(string{ program.substr(offset, length) });
+				if (translation[i] == Cache::NULL_ID) {
+					logger.Error("Failed to add patch program string <{}> to cache"sv, program.substr(offset, length));
+					return false;
+				}
+			}
+			return true;
+		}
+		[[nodiscard]] bool Translate(uint32 id, uint32& out) const noexcept {
+			if (id == NULL_ID) {
+				out = Cache::NULL_ID;
+				return true;
+			}
+			if (id >= translation.size()) {
+				return false;
+			}
+			out = translation[id];
+			return true;
+		}
+		[[nodiscard]] bool ReadNode(Node& out, szt depth) {
+			if (next >= node_count) {
+				logger.Error("Patch program nodes reference more subnodes than it has"sv);
+				return false;
+			}
+			if (depth > MAX_DEPTH) {
+				logger.Error("Patch program nests nodes deeper than {}"sv, MAX_DEPTH);
+				return false;
+			}
+			const char* record{ program.data() + nodes_offset + szt{ next++ } * NODE_SIZE };
+			uint32 sigID{}, newsigID{}, comparesigID{}, ordersigID{};
+			if (!Translate(Get(record), sigID) || !Translate(Get(record + 4u), newsigID) || !Translate(Get(record + 8u), comparesigID) || !Translate(Get(record + 12u), ordersigID)) {
+				logger.Error("Patch program node {} references a string it doesn't have"sv, next - 1u);
+				return false;
+			}
+			const uint32 raw{ Get(record + 16u) };
+			if (raw >> Flag::Opaque != 0u) { //Diffs only use operation and type flags
+				logger.Error("Patch program node {} has unknown flags {:#x}"sv, next - 1u, raw);
+				return false;
+			}
+			Node::NodeFlags flags{};
+			for (uint32 bit{ 0u }; bit < Flag::Opaque; ++bit) {
+				if ((raw >> bit) & 1u) {
+					flags.Set(static_cast<Flag>(bit));
+				}
+			}
+
+			out = Node{ sigID, newsigID, comparesigID, flags, ordersigID, Get(record + 20u) };
+			const uint32 subnodes{ Get(record + 24u) };
+			for (uint32 i{ 0u }; i < subnodes; ++i) {
+				Node child{};
+				if (!ReadNode(child, depth + 1u) || !out.AddSubnode(std::move(child))) {
+					return false;
+				}
+			}
+			out.UpdateHash();
+			return true;
+		}
+	};
+
+
+
+	//PatchProgram	public
+	[[nodiscard]] bool PatchProgram::Write(const string& target_path, const vector<Node>& nodes, const Cache& source_cache, string& out) noexcept {
+		try {
+			std::unordered_map<uint32, uint32> strings{};	//source_cache ID to program string ID
+			vector<uint32> string_ids{};					//Program string ID to source_cache ID
+			string node_bytes{};
+			for (const auto& node : nodes) {
+				if (!WriteNode(node, source_cache, strings, string_ids, node_bytes)) {
+					return false;
+				}
+			}
+
+			const szt path_offset{ HEADER_SIZE };
+			const szt strings_offset{ path_offset + target_path.size() };
+			szt string_bytes_offset{ strings_offset + string_ids.size() * STRING_SIZE };
+			szt nodes_offset{ string_bytes_offset };
+			for (const uint32 id : string_ids) {
+				nodes_offset += source_cache.Find(id).size();
+			}
+			if (nodes_offset + node_bytes.size() > NULL_ID) {
+				logger.Error("Diff for <{}> is too big to compile"sv, target_path);
+				return false;
+			}
+
+			out.clear();
+			out.reserve(nodes_offset + node_bytes.size());
+			out += MAGIC;
+			for (const uint32 field : { VERSION, static_cast<uint32>(path_offset), static_cast<uint32>(target_path.size()), static_cast<uint32>(string_ids.size()), static_cast<uint32>(strings_offset),
+				static_cast<uint32>(node_bytes.size() / NODE_SIZE), static_cast<uint32>(nodes_offset), static_cast<uint32>(nodes.size()) }) {
+				Put(out, field);
+			}
+			out += target_path;
+			for (const uint32 id : string_ids) {
+				const string& str{ source_cache.Find(id) };
+				Put(out, static_cast<uint32>(string_bytes_offset));
+				Put(out, static_cast<uint32>(str.size()));
+				string_bytes_offset += str.size();
+			}
+			for (const uint32 id : string_ids) {
+				out += source_cache.Find(id);
+			}
+			out += node_bytes;
+			return true;
+		}
+		catch (...) {
+			logger.Error("Unspecified exception while compiling diff for <{}>"sv, target_path);
+			out.clear();
+			return false;
+		}
+	}
+
+	[[nodiscard]] bool PatchProgram::Read(string_view program, Cache& dest_cache, vector<Node>& out) noexcept {
+		try {
+			Reader reader{ program, dest_cache };
+			if (!reader.ReadAll(out)) {
+				out.clear();
+				return false;
+			}
+			return true;
+		}
+		catch (...) {
+			logger.Error("Unspecified exception while loading patch program"sv);
+			out.clear();
+			return false;
+		}
+	}
+
+	[[nodiscard]] bool PatchProgram::ReadTargetPath(string_view program, string& out) noexcept {
+		try {
+			if (!IsProgram(program) || program.size() < HEADER_SIZE) {
+				return false;
+			}
+			const uint32 offset{ Get(program.data() + PathOffset * sizeof(uint32)) }, length{ Get(program.data() + PathLength * sizeof(uint32)) };
+			if (offset > program.size() || length > program.size() - offset) {
+				return false;
+			}
+			out = program.substr(offset, length);
+			return true;
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	[[nodiscard]] bool PatchProgram::IsProgram(string_view data) noexcept { return data.substr(0u, MAGIC.size()) == MAGIC; }
+
+
+
+	//PatchProgram	private
+	void PatchProgram::Put(string& out, uint32 value) {
+		for (szt i{ 0u }; i < sizeof(uint32); ++i) {
+			out += static_cast<char>((value >> (8u * i)) & 0xFFu);
+		}
+	}
+	[[nodiscard]] uint32 PatchProgram::Get(const char* at) noexcept {
+		uint32 value{ 0u };
+		for (szt i{ 0u }; i < sizeof(uint32); ++i) {
+			value |= uint32{ static_cast<uint8>(at[i]) } << (8u * i);
+		}
+		return value;
+	}
+
+	[[nodiscard]] bool PatchProgram::WriteNode(const Node& node, const Cache& source_cache, std::unordered_map<uint32, uint32>& strings, vector<uint32>& string_ids, string& out) {
+		if (node.Any(Flag::Opaque)) {
+			logger.Error("<{}> was never generated and can't be compiled"sv, source_cache.Find(node.GetSigID()));
+			return false;
+		}
+		auto translate = [&](uint32 sourceID) -> uint32 {
+			if (sourceID == Cache::NULL_ID) {
+				return NULL_ID;
+			}
+			auto [it, added] { strings.try_emplace(sourceID, static_cast<uint32>(string_ids.size())) };
+			if (added) {
+				string_ids.push_back(sourceID);
+			}
+			return it->second;
+		};
+		Put(out, translate(node.GetSigID()));
+		Put(out, translate(node.GetNewsigID()));
+		Put(out, translate(node.GetComparesigID()));
+		Put(out, translate(node.GetOrdersigID()));
+		Put(out, node.GetFlags().Raw());
+		Put(out, static_cast<uint32>(std::min<uint64>(node.GetSourceLine(), NULL_ID)));
+		Put(out, static_cast<uint32>(node.GetNumSubnodes()));
+		for (NodeCIterator child{ node.CBegin() }; child != node.CEnd(); ++child) {
+			if (!WriteNode(*child, source_cache, strings, string_ids, out)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+}
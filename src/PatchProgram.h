@@ -0,0 +1,60 @@
+#pragma once
+#include "Common.h"
+#include "StringParser.h"
+
+#include <limits>
+#include <unordered_map>
+
+
+namespace StringParser {
+
+	//Compiled diff tree. Loading one skips all of the diff's text processing: signatures are already formatted, validated and interned to a string table,
+	//and nodes are stored in pre-order with their operations. Every number is a fixed width little endian uint32 read in place, so a program can be loaded
+	//straight from a mapped file.
+	//
+	//Layout:
+	//	Header			MAGIC, VERSION, then the offset and length of each section below, counted in bytes from the start of the program
+	//	Target path		The diff's first line
+	//	String table	(offset, length) of each string, followed by the strings' bytes
+	//	Nodes			(sigID, newsigID, comparesigID, ordersigID, flags, sourceline, subnode count) per node, in pre-order. IDs index the string table.
+	class PatchProgram {
+	public:
+		using Node = Parser::Node;
+		using Cache = Parser::Cache;
+		static constexpr string_view MAGIC{ "DLPP" };
+		static constexpr uint32 VERSION{ 1u };	//Bump on any layout change. Programs of other versions are rejected and need to be compiled again.
+		static constexpr uint32 NULL_ID{ std::numeric_limits<uint32>::max() };
+
+
+		[[nodiscard]] static bool Write(const string& target_path, const vector<Node>& nodes, const Cache& source_cache, string& out) noexcept;
+		[[nodiscard]] static bool Read(string_view program, Cache& dest_cache, vector<Node>& out) noexcept;
+		[[nodiscard]] static bool ReadTargetPath(string_view program, string& out) noexcept;
+		[[nodiscard]] static bool IsProgram(string_view data) noexcept;	//Only checks MAGIC, so the first MAGIC.size() bytes are enough
+
+	private:
+		//Header fields in order, each a uint32
+		enum Field : uint32 {
+			Magic,
+			Version,
+			PathOffset,
+			PathLength,
+			StringCount,
+			StringsOffset,
+			NodeCount,
+			NodesOffset,
+			RootCount,
+
+			HEADER_FIELDS
+		};
+		static constexpr szt HEADER_SIZE{ HEADER_FIELDS * sizeof(uint32) };
+		static constexpr szt STRING_SIZE{ 2u * sizeof(uint32) };
+		static constexpr szt NODE_SIZE{ 7u * sizeof(uint32) };
+
+		class Reader;
+
+		static void Put(string& out, uint32 value);
+		[[nodiscard]] static uint32 Get(const char* at) noexcept;
+		[[nodiscard]] static bool WriteNode(const Node& node, const Cache& source_cache, std::unordered_map<uint32, uint32>& strings, vector<uint32>& string_ids, string& out);
+	};
+
+}
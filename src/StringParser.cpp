@@ -1,6 +1,9 @@
 #include "StringParser.h"
+#include "PatchProgram.h"
+#include "ThreadPool.h"
 
 #include <algorithm>
+#include <unordered_set>
 
 namespace StringParser {
 
@@ -25,64 +28,37 @@ namespace StringParser {
 	using NodeCIterator = Node::NodeCIterator;
 
 	namespace helpers {
-		[[nodiscard]] bool ValidateBraces(const string& str) noexcept {
-			szt line{ 1u };
-			szt pos{ 0u };
-			int64 opens{ 0 };
-
-			while (pos < str.length()) {
-				if (str[pos] == '\n')
-					++line;
-				else if (str[pos] == '{')
-					++opens;
-				else if (str[pos] == '}')
-					--opens;
-				if (opens < 0) {
-					logger.Error("No matching opening <{> for closing <}> in line {}"sv, line);
-					return false;
-				}
-
-				++pos;
-			}
-
-			if (opens > 0) {
-				logger.Error("Expected closing <}> in line {}"sv, line);
+		//Log and return false if structure found mismatched braces or parens
+		[[nodiscard]] bool ValidateBraces(const StructuralIndex& structure) noexcept {
+			using Kind = StructuralIndex::Mismatch::Kind;
+			const auto& mismatch{ structure.BraceMismatch() };
+			switch (mismatch.kind) {
+			case Kind::UnopenedBrace:
+				logger.Error("No matching opening <{> for closing <}> in line {}"sv, mismatch.line);
+				return false;
+			case Kind::UnclosedBrace:
+				logger.Error("Expected closing <}> in line {}"sv, mismatch.line);
 				return false;
+			default:
+				return true;
 			}
-
-			return true;
 		}
-		[[nodiscard]] bool ValidateParens(const string& str) noexcept {
-			szt line{ 1u };
-			szt pos{ 0u };
-			bool open{ false };
-
-			while (pos < str.length()) {
-				if (str[pos] == '\n')
-					++line;
-				else if (str[pos] == '(') {
-					if (open) {
-						logger.Error("Invalid opening <(> in line {}"sv, line);
-						return false;
-					}
-					open = true;
-				}
-				else if (str[pos] == ')') {
-					if (!open) {
-						logger.Error("Invalid closing <)> in line {}"sv, line);
-						return false;
-					}
-					open = false;
-				}
-				++pos;
-			}
-
-			if (open) {
-				logger.Error("Expected closing <)> in line {}"sv, line);
+		[[nodiscard]] bool ValidateParens(const StructuralIndex& structure) noexcept {
+			using Kind = StructuralIndex::Mismatch::Kind;
+			const auto& mismatch{ structure.ParenMismatch() };
+			switch (mismatch.kind) {
+			case Kind::NestedParen:
+				logger.Error("Invalid opening <(> in line {}"sv, mismatch.line);
 				return false;
+			case Kind::UnopenedParen:
+				logger.Error("Invalid closing <)> in line {}"sv, mismatch.line);
+				return false;
+			case Kind::UnclosedParen:
+				logger.Error("Expected closing <)> in line {}"sv, mismatch.line);
+				return false;
+			default:
+				return true;
 			}
-
-			return true;
 		}
 		//Scr utils
 		//Return true if successfully read the thing starting from and including the current char. Leaves ts.index to point to last char of thing. No change if failure.
@@ -149,6 +125,20 @@ namespace StringParser {
 			ts.index = close;
 			return true;
 		}
+		//Same as above, but looks the closing '"' up in structure, which must index str
+		[[nodiscard]] bool ReadString(const string& str, traversal_state& ts, const StructuralIndex& structure) noexcept {
+			if (ts.index >= str.length() || str[ts.index] != '"') {
+				return false;
+			}
+
+			const szt close{ structure.Next(ts.index + 1, '"') };
+			if (close >= str.length() || structure.NewlinesBetween(ts.index + 1, close) != 0u) { //Don't allow multi-line strings
+				return false;
+			}
+
+			ts.index = close;
+			return true;
+		}
 		[[nodiscard]] bool FindScrSub(const string& str, traversal_state& ts, string& subsig) {
 			//ts.index = 0u;
 			subsig.clear();
@@ -675,6 +665,82 @@ namespace StringParser {
 			if (flags.Any(Flag::Function))			return "[Function] ";
 			return "[INVALID] ";
 		}
+		//True if merging dNode into tNode provably leaves tNode as-is. Exports are not handled here since they need the cache.
+		//Can throw while tracking which target nodes were reached
+		[[nodiscard]] bool RestatesTarget(const Node& dNode, const Parser::TargetIndex& index, Parser::TargetIndex::Location tLoc) {
+			const Node& tNode{ *index.GetNode(tLoc) };
+			if (dNode.Any(Flag::Insert, Flag::Rename, Flag::Delete)) {
+				return false;
+			}
+			if (dNode.Any(Flag::Redefine)) {
+				return dNode.Any(Flag::SubScope, Flag::SubDeclaration, Flag::Function) && dNode.SameSubnodes(tNode);
+			}
+			if (dNode.GetHash() == tNode.GetHash()) {
+				return true;
+			}
+			std::unordered_set<Parser::TargetIndex::Location> reached{};
+			for (NodeCIterator dChild{ dNode.CBegin() }; dChild != dNode.CEnd(); ++dChild) {
+				if (dChild->Any(Flag::Insert, Flag::Rename)) {
+					return false;
+				}
+				const Parser::TargetIndex::Location cLoc{ index.Child(tLoc, dChild->GetComparesigID()) };
+				if (cLoc == Parser::TargetIndex::NOT_FOUND) {
+					if (dChild->Any(Flag::Delete)) {
+						continue; //Deleting something that isn't there
+					}
+					return false;
+				}
+				if (!reached.insert(cLoc).second) {
+					return false; //Operating on a node twice is an error Parse() reports
+				}
+				if (!RestatesTarget(*dChild, index, cLoc)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		//Writes depth tabs to dest from a static table and returns one past the last tab
+		char* WriteIndent(char* dest, szt depth) noexcept {
+			static constexpr string_view tabs{ "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t" };
+			while (depth > tabs.size()) {
+				dest = std::copy(tabs.cbegin(), tabs.cend(), dest);
+				depth -= tabs.size();
+			}
+			return std::copy_n(tabs.cbegin(), depth, dest);
+		}
+		//Re-interns node's signatures, subnodes included, from one cache to another
+		[[nodiscard]] bool TranslateSignatures(Node& node, const Cache& from, Cache& to, std::unordered_map<uint32, uint32>& translation) {
+			auto translate = [&](uint32 id) -> uint32 {
+				if (id == Cache::NULL_ID) {
+					return Cache::NULL_ID;
+				}
+				if (auto it{ translation.find(id) }; it != translation.end()) {
+					return it->second;
+				}
+				const uint32 toID{ to.FindOrAdd(from.Find(id)) };
+				if (toID != Cache::NULL_ID) {
+					translation.emplace(id, toID);
+				}
+				return toID;
+			};
+			const uint32 sigID{ translate(node.GetSigID()) }, newsigID{ translate(node.GetNewsigID()) }, comparesigID{ translate(node.GetComparesigID()) }, ordersigID{ translate(node.GetOrdersigID()) };
+			if ((sigID == Cache::NULL_ID) != (node.GetSigID() == Cache::NULL_ID) || (newsigID == Cache::NULL_ID) != (node.GetNewsigID() == Cache::NULL_ID)
+				|| (comparesigID == Cache::NULL_ID) != (node.GetComparesigID() == Cache::NULL_ID) || (ordersigID == Cache::NULL_ID) != (node.GetOrdersigID() == Cache::NULL_ID)) {
+				return false;
+			}
+			node.SetSigID(sigID);
+			node.SetNewsigID(newsigID);
+			node.SetComparesigID(comparesigID);
+			node.SetOrderSigID(ordersigID);
+			for (NodeIterator child{ node.Begin() }; child != node.End(); ++child) {
+				if (!TranslateSignatures(*child, from, to, translation)) {
+					return false;
+				}
+			}
+			node.UpdateHash();
+			return true;
+		}
 	}
 	using namespace helpers;
 
@@ -686,13 +752,16 @@ namespace StringParser {
 		, flags(op)
 		, ordersigID(bkID)
 		, sourceline(srcln)
+		, hash(LeafHash())
 	{}
 
 	Node& Node::AddAndReturnSubnode(uint32 sID, uint32 nsID, uint32 cmpID, NodeFlags op, uint32 bkID, uint64 srcln) noexcept {
+		span_end = 0u;
 		try { return subnodes.emplace_back(sID, nsID, cmpID, op, bkID, srcln); }
 		catch (...) { logger.Critical("Unrecoverable error: Failed to construct-add node with signature ID {}"sv, sID); std::terminate(); }
 	}
 	Node& Node::AddAndReturnSubnode(const Node& node) noexcept {
+		span_end = 0u;
 		if (!PushBackNoEx(subnodes, node)) {
 			logger.Critical("Unrecoverable error: Failed to copy-add node with signature ID {}"sv, node.GetSigID());
 			std::terminate();
@@ -700,6 +769,7 @@ namespace StringParser {
 		return subnodes.back();
 	}
 	Node& Node::AddAndReturnSubnode(Node&& node) noexcept {
+		span_end = 0u;
 		if (!PushBackNoEx(subnodes, std::move(node))) {
 			logger.Critical("Unrecoverable error: Failed to move-add node with signature ID {}"sv, node.GetSigID());
 			std::terminate();
@@ -707,10 +777,12 @@ namespace StringParser {
 		return subnodes.back();
 	}
 	bool Node::AddSubnode(uint32 sID, uint32 nsID, uint32 cmpID, NodeFlags op, uint32 bkID, uint64 srcln) noexcept {
+		span_end = 0u;
 		try { subnodes.emplace_back(sID, nsID, cmpID, op, bkID, srcln); return true; }
 		catch (...) { logger.Critical("Unspecified error: Failed to construct-add node with signature ID {}"sv, sID); return false; }
 	}
 	bool Node::AddSubnode(const Node& node) noexcept {
+		span_end = 0u;
 		if (!PushBackNoEx(subnodes, node)) {
 			logger.Critical("Unspecified error: Failed to copy-add node with signature ID {}"sv, node.GetSigID());
 			return false;
@@ -718,6 +790,7 @@ namespace StringParser {
 		return true;
 	}
 	bool Node::AddSubnode(Node&& node) noexcept {
+		span_end = 0u;
 		if (!PushBackNoEx(subnodes, std::move(node))) {
 			logger.Critical("Unspecified error: Failed to move-add node with signature ID {}"sv, node.GetSigID());
 			return false;
@@ -727,6 +800,7 @@ namespace StringParser {
 
 	bool Node::DeleteSubnode(const uint32 id) noexcept {
 		if (NodeIterator iter{ Find(id) }; iter != subnodes.end()) {
+			span_end = 0u;
 			subnodes.erase(iter);
 			return true;
 		}
@@ -740,17 +814,42 @@ namespace StringParser {
 		return false;
 	}
 
-	void Node::SetSigID(const uint32 newid) noexcept { sigID = newid; }
+	void Node::SetSigID(const uint32 newid) noexcept { sigID = newid; span_end = 0u; }
 	void Node::SetNewsigID(const uint32 newnewid) noexcept { newsigID = newnewid; }
 	void Node::SetComparesigID(const uint32 newcompid) noexcept { comparesigID = newcompid; }
 	bool Node::SetSubnodes(const NodeVector& newsubnodes) noexcept {
-		try { subnodes = newsubnodes; return true; }
+		try { subnodes = newsubnodes; span_end = 0u; return true; }
 		catch (...) { return false; }
 	}
-	void Node::SetFlags(const NodeFlags newop) noexcept { flags = newop; }
+	void Node::SetFlags(const NodeFlags newop) noexcept { flags = newop; span_end = 0u; }
 	void Node::SetOrder(const uint32 neworder) noexcept { order = neworder; }
 	void Node::SetOrderSigID(const uint32 newid) noexcept { ordersigID = newid; }
 	void Node::SetSourceLine(const uint64 newsourceline) noexcept { sourceline = newsourceline; }
+	//Set once the node is final. Any later edit through the setters clears it.
+	void Node::SetSourceSpan(const uint32 begin, const uint32 end) noexcept { span_begin = begin; span_end = end; }
+	//Recomputes the fingerprint from the current subnode fingerprints. Not recursive, so subnodes must be up to date first.
+	void Node::UpdateHash() noexcept {
+		hash = LeafHash();
+		for (const auto& child : subnodes) {
+			hash = HashCombine(hash, child.hash);
+		}
+	}
+	//Uses the compare signature and leaves type flags and Noop out, so a diff node that only restates its target fingerprints the same as it.
+	[[nodiscard]] uint64 Node::LeafHash() const noexcept {
+		uint64 result{ HashCombine(0u, comparesigID) };
+		for (const Flag op : { Flag::Insert, Flag::Rename, Flag::Redefine, Flag::Delete }) {
+			if (flags.Any(op)) {
+				result = HashCombine(result, op);
+			}
+		}
+		if (flags.Any(Flag::Rename, Flag::Redefine)) {
+			result = HashCombine(result, newsigID);
+		}
+		if (flags.Any(Flag::Opaque)) { //Contents unknown, so never equal to a generated node
+			result = HashCombine(HashCombine(result, static_cast<uint64>(Flag::Opaque)), span_begin);
+		}
+		return result;
+	}
 
 	[[nodiscard]] uint32 Node::GetSigID() const noexcept { return sigID; }
 	[[nodiscard]] uint32 Node::GetNewsigID() const noexcept { return newsigID; }
@@ -761,6 +860,34 @@ namespace StringParser {
 	[[nodiscard]] uint32 Node::GetOrder() const noexcept { return order; }
 	[[nodiscard]] uint32 Node::GetOrdersigID() const noexcept { return ordersigID; }
 	[[nodiscard]] uint64 Node::GetSourceLine() const noexcept { return sourceline; }
+	[[nodiscard]] std::pair<uint32, uint32> Node::GetSourceSpan() const noexcept { return { span_begin, span_end }; }
+	[[nodiscard]] uint64 Node::GetHash() const noexcept { return hash; }
+	[[nodiscard]] bool Node::SameSubnodes(const Node& other) const noexcept {
+		if (subnodes.size() != other.subnodes.size()) {
+			return false;
+		}
+		for (szt i{ 0u }; i < subnodes.size(); ++i) {
+			if (subnodes[i].comparesigID != other.subnodes[i].comparesigID || subnodes[i].hash != other.subnodes[i].hash) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//True if the subtree still reads exactly like its span of source: it has one, and it and its subnodes weren't edited or reordered since
+	[[nodiscard]] bool Node::IsVerbatim(string_view source) const noexcept {
+		if (span_end == 0u || span_end > source.size()) {
+			return false;
+		}
+		uint32 previous_end{ span_begin };
+		for (const auto& child : subnodes) {
+			if (child.span_begin < previous_end || child.span_end > span_end || !child.IsVerbatim(source)) {
+				return false;
+			}
+			previous_end = child.span_end;
+		}
+		return true;
+	}
 
 	[[nodiscard]] NodeVector Node::CopySubnodes() const { return subnodes; }
 	[[nodiscard]] const NodeVector& Node::GetSubnodesRef() const noexcept { return subnodes; }
@@ -826,21 +953,50 @@ namespace StringParser {
 	}
 
 	[[nodiscard]] string Node::ToString(szt depth, const Cache& string_cache) const {
-		string indent(depth, '\t');
-		string result{ indent + string_cache.Find(sigID) };
+		string result(SerializedSize(depth, string_cache), '\0');
+		SerializeTo(depth, string_cache, result.data());
+		return result;
+	}
+	[[nodiscard]] szt Node::SerializedSize(szt depth, const Cache& string_cache, string_view source) const noexcept {
+		if (IsVerbatim(source)) {
+			return depth + (span_end - span_begin);
+		}
+		szt size{ depth + string_cache.Find(sigID).size() };
 
 		if (subnodes.empty()) {
-			if (!flags.Any(Flag::Import, Flag::Include, Flag::Vardecl)) result += ';';
-			return result;
+			return size + (flags.Any(Flag::Import, Flag::Include, Flag::Vardecl) ? 0u : 1u);
 		}
 
-		result += " {\n";
+		size += 3u; //" {\n"
 		for (const auto& child : subnodes) {
-			result += child.ToString(depth + 1u, string_cache) + '\n';
+			size += child.SerializedSize(depth + 1u, string_cache, source) + 1u;
 		}
-		result += indent + '}';
+		return size + depth + 1u;
+	}
+	char* Node::SerializeTo(szt depth, const Cache& string_cache, char* dest, string_view source) const noexcept {
+		dest = WriteIndent(dest, depth);
+		if (IsVerbatim(source)) {
+			return std::copy_n(source.data() + span_begin, span_end - span_begin, dest);
+		}
+		const string& sig{ string_cache.Find(sigID) };
+		dest = std::copy(sig.cbegin(), sig.cend(), dest);
 
-		return result;
+		if (subnodes.empty()) {
+			if (!flags.Any(Flag::Import, Flag::Include, Flag::Vardecl)) *dest++ = ';';
+			return dest;
+		}
+
+		*dest++ = ' ';
+		*dest++ = '{';
+		*dest++ = '\n';
+		for (const auto& child : subnodes) {
+			dest = child.SerializeTo(depth + 1u, string_cache, dest, source);
+			*dest++ = '\n';
+		}
+		dest = WriteIndent(dest, depth);
+		*dest++ = '}';
+
+		return dest;
 	}
 	[[nodiscard]] string Node::ToStringAttr(szt depth, const Cache& string_cache) const {
 		string indent(depth, '\t');
@@ -878,15 +1034,411 @@ namespace StringParser {
 
 
 
+	//TargetIndex
+	using TargetIndex = Parser::TargetIndex;
+	using Location = TargetIndex::Location;
+
+	[[nodiscard]] bool TargetIndex::Build(const vector<Node>& roots) noexcept {
+		try {
+			Clear();
+			entries.push_back({});
+			AddChildren(ROOT, roots);
+			if (entries.size() > std::numeric_limits<uint32>::max()) {
+				logger.Error("Target has too many nodes to index"sv);
+				Clear();
+				return false;
+			}
+			return true;
+		}
+		catch (...) {
+			logger.Error("Failed to build target index. Possibly out of memory?"sv);
+			Clear();
+			return false;
+		}
+	}
+	void TargetIndex::Clear() noexcept {
+		entries.clear();
+		children.clear();
+		anywhere.clear();
+	}
+
+	[[nodiscard]] Location TargetIndex::Child(Location parent, uint32 comparesigID) const noexcept {
+		if (auto it{ children.find((static_cast<uint64>(parent) << 32) | comparesigID) }; it != children.end()) {
+			return it->second;
+		}
+		return NOT_FOUND;
+	}
+	[[nodiscard]] Location TargetIndex::ChildAt(Location parent, szt position) const noexcept {
+		if (parent >= entries.size() || entries[parent].first_child == NOT_FOUND) {
+			return NOT_FOUND;
+		}
+		return entries[parent].first_child + position;
+	}
+	[[nodiscard]] Location TargetIndex::Find(const vector<uint32>& path) const noexcept {
+		Location loc{ entries.empty() ? NOT_FOUND : ROOT };
+		for (szt i{ 0u }; i < path.size() && loc != NOT_FOUND; ++i) {
+			loc = Child(loc, path[i]);
+		}
+		return loc;
+	}
+	[[nodiscard]] Location TargetIndex::FindAnywhere(uint32 comparesigID) const noexcept {
+		if (auto it{ anywhere.find(comparesigID) }; it != anywhere.end()) {
+			return it->second;
+		}
+		return NOT_FOUND;
+	}
+	[[nodiscard]] const Node* TargetIndex::GetNode(Location loc) const noexcept { return loc < entries.size() ? entries[loc].node : nullptr; }
+	[[nodiscard]] Location TargetIndex::GetParent(Location loc) const noexcept { return loc < entries.size() ? entries[loc].parent : NOT_FOUND; }
+	[[nodiscard]] szt TargetIndex::GetPosition(Location loc) const noexcept {
+		if (loc == ROOT || loc >= entries.size()) {
+			return 0u;
+		}
+		return loc - entries[entries[loc].parent].first_child;
+	}
+
+	//Reserves a contiguous block for all of nodes first, so position lookups are a subtraction
+	void TargetIndex::AddChildren(Location parent, const vector<Node>& nodes) {
+		if (nodes.empty()) {
+			return;
+		}
+		const Location first{ entries.size() };
+		entries[parent].first_child = first;
+		for (const auto& node : nodes) {
+			const Location loc{ entries.size() };
+			entries.push_back({ &node, parent, NOT_FOUND });
+			children.emplace((static_cast<uint64>(parent) << 32) | node.GetComparesigID(), loc); //emplace keeps the first of duplicate signatures
+		}
+		for (szt i{ 0u }; i < nodes.size(); ++i) {
+			anywhere.emplace(nodes[i].GetComparesigID(), first + i);
+			AddChildren(first + i, nodes[i].GetSubnodesRef());
+		}
+	}
+
+
+
+	//Parser::DiffTree
+	[[nodiscard]] bool Parser::DiffTree::Generate(const string& diff_str) noexcept {
+		try {
+			Parser parser{};
+			return parser.SetDiff(diff_str) && TakeFrom(parser);
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to generate diff tree"sv);
+			return false;
+		}
+	}
+	[[nodiscard]] bool Parser::DiffTree::Generate(string&& diff_str) noexcept {
+		try {
+			Parser parser{};
+			return parser.SetDiff(std::move(diff_str)) && TakeFrom(parser);
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to generate diff tree"sv);
+			return false;
+		}
+	}
+	[[nodiscard]] bool Parser::DiffTree::Load(string_view program) noexcept {
+		try {
+			Parser parser{};
+			return parser.SetDiffProgram(program) && TakeFrom(parser);
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to load diff tree"sv);
+			return false;
+		}
+	}
+	[[nodiscard]] const string& Parser::DiffTree::GetTargetPath() const noexcept { return target_path; }
+	[[nodiscard]] bool Parser::DiffTree::TakeFrom(Parser& parser) {
+		Locker locker{ parser.lock };
+		nodes = std::move(parser.diff);
+		cache = std::move(parser.string_cache);
+		target_path = std::move(parser.target_path);
+		filetype = parser.filetype;
+		parser.ResetImpl();
+		return true;
+	}
+
+
+	//Parser::TargetTree
+	[[nodiscard]] bool Parser::TargetTree::Generate(const string& path, const string& target_str) noexcept {
+		try {
+			string str{ target_str };
+			return Generate(path, std::move(str));
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to generate target tree"sv);
+			return false;
+		}
+	}
+	[[nodiscard]] bool Parser::TargetTree::Generate(const string& path, string&& target_str) noexcept {
+		try {
+			Parser parser{};
+			if (!parser.DeduceFileInfo(path)) {
+				logger.Error("Invalid packed file path or extension <{}>"sv, path);
+				return false;
+			}
+			if (!parser.SetFile(target_str, false)) {
+				logger.Error("Failed to generate target tree for <{}>"sv, path);
+				return false;
+			}
+			//SetFile() already indexed the nodes. Moving the vector keeps its buffer, so the index's node pointers stay valid.
+			nodes = std::move(parser.target);
+			index = std::move(parser.target_index);
+			cache = std::move(parser.string_cache);
+			source = std::move(parser.target_source);
+			target_path = std::move(parser.target_path);
+			filetype = parser.filetype;
+			return true;
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to generate target tree"sv);
+			return false;
+		}
+	}
+	[[nodiscard]] const string& Parser::TargetTree::GetTargetPath() const noexcept { return target_path; }
+	[[nodiscard]] bool Parser::TargetTree::Intern(NodeStore& new_store) noexcept {
+		try {
+			if (store != nullptr) {
+				return store == &new_store;
+			}
+			vector<NodeStore::ID> ids{};
+			vector<NodeStore::Placement> new_placements{};
+			new_placements.reserve(nodes.size());
+			if (!new_store.Intern(nodes, cache, ids, new_placements)) {
+				logger.Error("Failed to store target tree for <{}>"sv, target_path);
+				return false;
+			}
+			new_placements.shrink_to_fit();
+			store = &new_store;
+			roots = std::move(ids);
+			placements = std::move(new_placements);
+			index.Clear();
+			nodes = vector<Node>{};
+			cache.Reset();
+			return true;
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to store target tree"sv);
+			return false;
+		}
+	}
+	[[nodiscard]] bool Parser::TargetTree::IsInterned() const noexcept { return store != nullptr; }
+	[[nodiscard]] bool Parser::TargetTree::Materialize(vector<Node>& out, TargetIndex& out_index) const {
+		if (!store->Materialize(roots, placements, out) || !out_index.Build(out)) {
+			logger.Error("Failed to rebuild target tree for <{}> from its node store"sv, target_path);
+			return false;
+		}
+		return true;
+	}
+
+
+
+	//Parser::NodeStore
+	[[nodiscard]] bool Parser::NodeStore::Intern(const vector<Node>& nodes, const Cache& nodes_cache, vector<ID>& ids, vector<Placement>& placements) noexcept {
+		try {
+			std::unordered_map<uint32, uint32> translation{};	//nodes_cache ID to strings ID
+			ids.clear();
+			ids.reserve(nodes.size());
+			for (const auto& node : nodes) {
+				const ID id{ InternNode(node, nodes_cache, translation, placements) };
+				if (id == NULL_ID) {
+					return false;
+				}
+				ids.push_back(id);
+			}
+			return true;
+		}
+		catch (...) {
+			logger.Error("Unspecified exception while adding nodes to node store"sv);
+			return false;
+		}
+	}
+	[[nodiscard]] bool Parser::NodeStore::Materialize(const vector<ID>& ids, const vector<Placement>& placements, vector<Node>& out) const noexcept {
+		try {
+			out.clear();
+			out.reserve(ids.size());
+			szt next{ 0u };
+			for (const ID id : ids) {
+				Node node{};
+				if (!MaterializeNode(id, placements, next, node) || !PushBackNoEx(out, std::move(node))) {
+					return false;
+				}
+			}
+			if (next != placements.size()) {
+				logger.Error("Node store was given {} placements for {} nodes"sv, placements.size(), next);
+				return false;
+			}
+			return true;
+		}
+		catch (...) {
+			logger.Error("Unspecified exception while building nodes from node store"sv);
+			return false;
+		}
+	}
+	[[nodiscard]] const Cache& Parser::NodeStore::Strings() const noexcept { return strings; }
+
+	[[nodiscard]] szt Parser::NodeStore::Size() const noexcept { return entries.size(); }
+	[[nodiscard]] szt Parser::NodeStore::Interned() const noexcept { return interned; }
+	[[nodiscard]] double Parser::NodeStore::DedupRatio() const noexcept {
+		return entries.empty() ? 1.0 : static_cast<double>(interned) / static_cast<double>(entries.size());
+	}
+	[[nodiscard]] szt Parser::NodeStore::Bytes() const noexcept {
+		constexpr szt LOOKUP_NODE{ sizeof(std::pair<const uint64, ID>) + 2u * sizeof(void*) };	//Key, value and the links of one bucket entry
+		return entries.capacity() * sizeof(Entry) + children.capacity() * sizeof(ID) + lookup.size() * LOOKUP_NODE + lookup.bucket_count() * sizeof(void*);
+	}
+
+	void Parser::NodeStore::Clear() noexcept {
+		entries.clear();
+		children.clear();
+		lookup.clear();
+		strings.Reset();
+		interned = 0u;
+	}
+
+	//Children are stored before their parent, so a parent is only looked up once its children have their final IDs
+	[[nodiscard]] Parser::NodeStore::ID Parser::NodeStore::InternNode(const Node& node, const Cache& nodes_cache, std::unordered_map<uint32, uint32>& translation, vector<Placement>& placements) {
+		if (node.Any(Flag::Opaque)) {
+			logger.Error("<{}> was never generated, so it can't be stored"sv, nodes_cache.Find(node.GetSigID()));
+			return NULL_ID;
+		}
+		const auto [span_begin, span_end] { node.GetSourceSpan() };
+		placements.push_back({ span_begin, span_end, node.GetSourceLine() });
+
+		vector<ID> child_ids{};
+		child_ids.reserve(node.GetNumSubnodes());
+		for (const auto& child : node.GetSubnodesRef()) {
+			const ID childID{ InternNode(child, nodes_cache, translation, placements) };
+			if (childID == NULL_ID) {
+				return NULL_ID;
+			}
+			child_ids.push_back(childID);
+		}
+
+		auto translate = [&](uint32 id) -> uint32 {
+			if (id == Cache::NULL_ID) {
+				return Cache::NULL_ID;
+			}
+			if (auto it{ translation.find(id) }; it != translation.end()) {
+				return it->second;
+			}
+			const uint32 storeID{ strings.FindOrAdd(nodes_cache.Find(id)) };
+			if (storeID != Cache::NULL_ID) {
+				translation.emplace(id, storeID);
+			}
+			return storeID;
+		};
+		Entry entry{ translate(node.GetSigID()), translate(node.GetNewsigID()), translate(node.GetComparesigID()), translate(node.GetOrdersigID()), node.GetFlags(), 0u, static_cast<uint32>(child_ids.size()) };
+		if ((entry.sigID == Cache::NULL_ID) != (node.GetSigID() == Cache::NULL_ID) || (entry.newsigID == Cache::NULL_ID) != (node.GetNewsigID() == Cache::NULL_ID)
+			|| (entry.comparesigID == Cache::NULL_ID) != (node.GetComparesigID() == Cache::NULL_ID) || (entry.ordersigID == Cache::NULL_ID) != (node.GetOrdersigID() == Cache::NULL_ID)) {
+			logger.Error("Failed to add <{}>'s signatures to node store cache"sv, nodes_cache.Find(node.GetSigID()));
+			return NULL_ID;
+		}
+		++interned;
+
+		uint64 hash{ HashCombine(HashCombine(HashCombine(HashCombine(HashCombine(0u, entry.sigID), entry.newsigID), entry.comparesigID), entry.ordersigID), entry.flags.Raw()) };
+		for (const ID child : child_ids) {
+			hash = HashCombine(hash, child);
+		}
+		for (auto [it, end] { lookup.equal_range(hash) }; it != end; ++it) {
+			const Entry& stored{ entries[it->second] };
+			if (stored.sigID == entry.sigID && stored.newsigID == entry.newsigID && stored.comparesigID == entry.comparesigID && stored.ordersigID == entry.ordersigID
+				&& stored.flags == entry.flags && stored.child_count == entry.child_count
+				&& std::equal(child_ids.cbegin(), child_ids.cend(), children.cbegin() + stored.first_child)) {
+				return it->second;
+			}
+		}
+
+		if (entries.size() >= NULL_ID || children.size() + child_ids.size() > std::numeric_limits<uint32>::max()) {
+			logger.Error("Node store is full"sv);
+			return NULL_ID;
+		}
+		const ID id{ static_cast<ID>(entries.size()) };
+		entry.first_child = static_cast<uint32>(children.size());
+		children.insert(children.cend(), child_ids.cbegin(), child_ids.cend());
+		entries.push_back(entry);
+		lookup.emplace(hash, id);
+		return id;
+	}
+
+	[[nodiscard]] bool Parser::NodeStore::MaterializeNode(ID id, const vector<Placement>& placements, szt& next, Node& out) const {
+		if (id >= entries.size() || next >= placements.size()) {
+			logger.Error("Node store has no node {} or was given too few placements"sv, id);
+			return false;
+		}
+		const Entry& entry{ entries[id] };
+		const Placement& placement{ placements[next++] };
+		out = Node{ entry.sigID, entry.newsigID, entry.comparesigID, entry.flags, entry.ordersigID, placement.sourceline };
+		for (uint32 i{ 0u }; i < entry.child_count; ++i) {
+			Node child{};
+			if (!MaterializeNode(children[entry.first_child + i], placements, next, child) || !out.AddSubnode(std::move(child))) {
+				return false;
+			}
+		}
+		out.UpdateHash();
+		out.SetSourceSpan(placement.span_begin, placement.span_end); //Last, as adding subnodes clears it
+		return true;
+	}
+
+
+
 	//Parser	public
+	//Merges in a private parser that reads target's tree, index and source in place. Its cache is an overlay of target's, so only diff's
+	//signatures that target lacks and the merge's own strings are stored per call. Diff's nodes are copied to take the overlay's IDs.
+	[[nodiscard]] bool Parser::Merge(const DiffTree& diff, const TargetTree& target, string& out) noexcept {
+		try {
+			if (diff.filetype != target.filetype || diff.filetype == FileType::INVALID_FILETYPE) {
+				logger.Error("Diff for <{}> can't be merged into <{}>: formats differ"sv, diff.target_path, target.target_path);
+				return false;
+			}
+			//An interned target's nodes are rebuilt from its store for this merge, with the store's cache in place of the target's
+			vector<Node> stored_nodes{};
+			TargetIndex stored_index{};
+			const bool stored{ target.IsInterned() };
+			if (stored && !target.Materialize(stored_nodes, stored_index)) {
+				return false;
+			}
+			Parser workspace{};
+			workspace.filetype = target.filetype;
+			workspace.target_path = target.target_path;
+			workspace.string_cache = Cache{ stored ? &target.store->Strings() : &target.cache };
+			workspace.merge_target = stored ? &stored_nodes : &target.nodes;
+			workspace.merge_index = stored ? &stored_index : &target.index;
+			workspace.merge_source = &target.source;
+			workspace.diff = diff.nodes;
+			std::unordered_map<uint32, uint32> translation{};
+			for (auto& dNode : workspace.diff) {
+				if (!TranslateSignatures(dNode, diff.cache, workspace.string_cache, translation)) {
+					logger.Error("Failed to add diff signatures to <{}>'s cache"sv, target.target_path);
+					return false;
+				}
+			}
+			return workspace.Parse(out);
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to merge"sv);
+			return false;
+		}
+	}
+
 	[[nodiscard]] bool Parser::SetDiff(const string& diff_str) noexcept {
+		try {
+			string str{ diff_str };
+			++file_copies;
+			return SetDiff(std::move(str));
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to set diff"sv);
+			return false;
+		}
+	}
+	[[nodiscard]] bool Parser::SetDiff(string&& diff_str) noexcept {
 		try {
 			Locker locker{ lock };
 			if (!DeduceFileInfo(diff_str.substr(0u, diff_str.find('\n')))) {
 				logger.Error("Invalid packed file path or extension"sv);
 				return false;
 			}
-			return SetFile(diff_str, true); //Includes the '\n'
+			return SetFile(diff_str, true);
 		}
 		catch (...) {
 			logger.Error("Unknown exception while trying to set diff"sv);
@@ -894,7 +1446,123 @@ namespace StringParser {
 		}
 	}
 
+	[[nodiscard]] bool Parser::AddDiff(const string& diff_str) noexcept {
+		try {
+			string str{ diff_str };
+			++file_copies;
+			return AddDiff(std::move(str));
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to add diff"sv);
+			return false;
+		}
+	}
+	[[nodiscard]] bool Parser::AddDiff(string&& diff_str) noexcept {
+		try {
+			Locker locker{ lock };
+			if (!CheckAddedDiffTarget(diff_str.substr(0u, diff_str.find('\n')))) {
+				return false;
+			}
+
+			//Generate it in diff's place, keeping everything else
+			vector<Node> first{ std::move(diff) };
+			diff.clear();
+			adding_diff = true;
+			bool generated{ false };
+			try {
+				generated = SetFile(diff_str, true);
+			}
+			catch (...) {
+				generated = false;
+			}
+			adding_diff = false;
+			vector<Node> added{ std::move(diff) };
+			diff = std::move(first);
+			if (!generated) {
+				logger.Error("Failed to set added diff for <{}>"sv, target_path);
+				return false;
+			}
+			return QueueDiff(std::move(added));
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to add diff"sv);
+			return false;
+		}
+	}
+
+	[[nodiscard]] bool Parser::SetDiffProgram(string_view program) noexcept {
+		try {
+			Locker locker{ lock };
+			ResetImpl();
+			string path{};
+			if (!PatchProgram::ReadTargetPath(program, path) || !DeduceFileInfo(path)) {
+				logger.Error("Invalid patch program or packed file path"sv);
+				return false;
+			}
+			if (!PatchProgram::Read(program, string_cache, diff)) {
+				logger.Error("Failed to load patch program for <{}>"sv, target_path);
+				ResetImpl();
+				return false;
+			}
+			return true;
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to set diff from patch program"sv);
+			return false;
+		}
+	}
+
+	[[nodiscard]] bool Parser::AddDiffProgram(string_view program) noexcept {
+		try {
+			Locker locker{ lock };
+			string path{};
+			if (!PatchProgram::ReadTargetPath(program, path)) {
+				logger.Error("Invalid patch program"sv);
+				return false;
+			}
+			if (!CheckAddedDiffTarget(path)) {
+				return false;
+			}
+			vector<Node> added{};
+			if (!PatchProgram::Read(program, string_cache, added)) {
+				logger.Error("Failed to load added patch program for <{}>"sv, target_path);
+				return false;
+			}
+			return QueueDiff(std::move(added));
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to add diff from patch program"sv);
+			return false;
+		}
+	}
+
+	[[nodiscard]] bool Parser::CompileDiff(string& out) const noexcept {
+		try {
+			Locker locker{ lock };
+			if (diff.empty()) {
+				logger.Error("Compile requested but no diff is set"sv);
+				return false;
+			}
+			return PatchProgram::Write(target_path, diff, string_cache, out);
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to compile diff"sv);
+			return false;
+		}
+	}
+
 	[[nodiscard]] bool Parser::SetTarget(const string& target_str) noexcept {
+		try {
+			string str{ target_str };
+			++file_copies;
+			return SetTarget(std::move(str));
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to set target"sv);
+			return false;
+		}
+	}
+	[[nodiscard]] bool Parser::SetTarget(string&& target_str) noexcept {
 		try {
 			Locker locker{ lock };
 			return SetFile(target_str, false);
@@ -905,47 +1573,141 @@ namespace StringParser {
 		}
 	}
 
+	[[nodiscard]] bool Parser::StreamTarget(szt size_hint, const ChunkReader& read) noexcept {
+		try {
+			Locker locker{ lock };
+			string original{}, text{};
+			original.reserve(size_hint);
+			text.reserve(size_hint);
+			++file_copies; //original collects the whole file
+			source_map.Clear();
+			StringUtils::Preprocessor preprocessor{ text, &source_map };
+			//Line endings are collapsed as in SetFile(). A '\r' ending a chunk is held back until the next chunk shows whether it starts a "\r\n".
+			szt fed{ 0u };
+			const ChunkSink sink{ [&](string_view chunk) {
+				original.append(chunk);
+				CollapseCRLF(original, fed);
+				const szt ready{ original.length() - (original.ends_with('\r') ? 1u : 0u) };
+				const bool accepted{ preprocessor.Feed(string_view{ original }.substr(fed, ready - fed)) };
+				fed = ready;
+				return accepted;
+			} };
+			if (!read(sink) || !preprocessor.Feed(string_view{ original }.substr(fed)) || !preprocessor.Finish()) {
+				logger.Error("Failed to read target"sv);
+				HandleResets(false);
+				return false;
+			}
+			return GenerateFile(text, false, original);
+		}
+		catch (...) {
+			logger.Error("Unknown exception while trying to stream target"sv);
+			return false;
+		}
+	}
+
 	[[nodiscard]] string Parser::GetTargetPath() const { Locker locker{ lock }; return target_path; }
+	[[nodiscard]] szt Parser::GetFileCopies() const noexcept { return file_copies.load(); }
+
+	//True unless every diff node provably leaves its target as-is. Errs on the side of true, letting Parse() handle and report anything unusual.
+	[[nodiscard]] bool Parser::HasNetChanges() const noexcept {
+		try {
+			Locker locker{ lock };
+			if (!later_diffs.empty()) {
+				return true; //Later diffs see the earlier ones' results, not the target
+			}
+			std::unordered_set<Location> reached{};
+			for (const auto& dNode : diff) {
+				if (dNode.Any(Flag::Insert, Flag::Rename)) {
+					return true;
+				}
+				const Location tLoc{ target_index.Child(TargetIndex::ROOT, dNode.GetComparesigID()) };
+				if (tLoc == TargetIndex::NOT_FOUND) {
+					if (dNode.Any(Flag::Delete)) {
+						continue; //Deleting something that isn't there
+					}
+					return true;
+				}
+				if (!reached.insert(tLoc).second) {
+					return true; //A node operated on twice, which Parse() rejects
+				}
+				if (dNode.Any(Flag::Export) && dNode.Any(Flag::Redefine) && !dNode.Any(Flag::Delete)) {
+					const Node& tNode{ *target_index.GetNode(tLoc) };
+					if (string_cache.Find(string_cache.Find(tNode.GetComparesigID()) + " = " + string_cache.Find(dNode.GetNewsigID())) != tNode.GetSigID()) {
+						return true;
+					}
+				}
+				else if (!RestatesTarget(dNode, target_index, tLoc)) {
+					return true;
+				}
+			}
+			return false;
+		}
+		catch (...) {
+			return true;
+		}
+	}
+
+	void Parser::SetParallelMerge(bool enable) noexcept {
+		try {
+			Locker locker{ lock };
+			parallel_merge = enable;
+		}
+		catch (...) {
+			logger.Error("Parser::SetParallelMerge() failed and the setting was not changed"sv);
+		}
+	}
+
+	void Parser::SetLazyTarget(bool enable) noexcept {
+		try {
+			Locker locker{ lock };
+			lazy_target = enable;
+		}
+		catch (...) {
+			logger.Error("Parser::SetLazyTarget() failed and the setting was not changed"sv);
+		}
+	}
 
 	[[nodiscard]] bool Parser::Parse(string& out) noexcept {
 		try {
 			Locker locker{ lock };
-			if (diff.empty() || target.empty()) {
+			if (diff.empty() || merge_target->empty()) {
 				logger.Error("Error: Attempted to parse but not both diff and target trees are generated"sv);
 				return false;
 			}
 
-			switch (filetype) {
-			case FileType::scr:
-				if (!ParseScrLoot(out)) {
-					logger.Error("Failed to parse <scr> file"sv);
-					return false;
-				}
-				break;
-			case FileType::def:
-				if (!ParseDef(out)) {
-					logger.Error("Failed to parse <def> file"sv);
-					return false;
+			vector<Node> result{};
+			if (!MergeDiff(diff, result)) {
+				return false;
+			}
+			if (!later_diffs.empty()) {
+				//Each later diff merges into the tree the ones before it left, standing in for the target meanwhile.
+				//Untouched nodes keep their spans into target_source, so serializing once at the end still copies them verbatim.
+				vector<Node> base{ std::move(target) };
+				auto restore = [this, &base]() noexcept {
+					target = std::move(base);
+					return target_index.Build(target);
+				};
+				bool merged{ true };
+				try {
+					for (szt i{ 0u }; i < later_diffs.size() && merged; ++i) {
+						target = std::move(result);
+						result = {};
+						merged = target_index.Build(target) && MergeDiff(later_diffs[i], result);
+						if (!merged) {
+							logger.Error("Failed to apply diff {} of {} for <{}>"sv, i + 2u, later_diffs.size() + 1u, target_path);
+						}
+					}
 				}
-				break;
-			case FileType::loot:
-				if (!ParseScrLoot(out)) { //Yes, same function. Loot and Scr are almost identical.
-					logger.Error("Failed to parse <loot> file"sv);
-					return false;
+				catch (...) {
+					static_cast<void>(restore());
+					throw;
 				}
-				break;
-			case FileType::varlist:
-				if (!ParseVarlist(out)) {
-					logger.Error("Failed to parse <varlist.scr>"sv);
+				if (!restore() || !merged) {
 					return false;
 				}
-				break;
-			default:
-				logger.Error("Invalid target filetype"sv);
-				return false;
 			}
 
-			return true;
+			return Serialize(result, out);
 		}
 		catch (...) {
 			logger.Error("Unknown exception while trying to parse"sv);
@@ -991,38 +1753,59 @@ namespace StringParser {
 	}
 
 	//Parser	private
-	[[nodiscard]] bool Parser::SetFile(const string& str, bool isdiff) {
-		string str_copy{ [isdiff, &str] { if (isdiff) return str.substr(str.find('\n')); else return str; }() };
-		RemoveComments(str_copy);
-		if (!TabToSpace(str_copy)) {
-			logger.Error("TabToSpace failed for unspecified reasons"sv);
+	[[nodiscard]] bool Parser::SetFile(string& str, bool isdiff) {
+		if (isdiff) {
+			const szt firstline_end{ str.find('\n') };
+			if (firstline_end == string::npos) {
+				logger.Error("Diff for <{}> has nothing after its first line"sv, target_path);
+				HandleResets(isdiff);
+				return false;
+			}
+			str.erase(0u, firstline_end); //Keeps the '\n'
+		}
+		else {
+			CollapseCRLF(str); //Untouched nodes are copied from str as-is, so it must use the '\n' the rest of the output does
+		}
+		string text{};
+		text.reserve(str.size());
+		source_map.Clear();
+		StringUtils::Preprocessor preprocessor{ text, (isdiff ? nullptr : &source_map) };
+		if (!preprocessor.Feed(str) || !preprocessor.Finish()) {
+			logger.Error("Failed to remove comments for unspecified reasons"sv);
 			return false;
 		}
+		return GenerateFile(text, isdiff, str); //str is left as it was read, which is what untouched target nodes are copied from
+	}
+
+	[[nodiscard]] bool Parser::GenerateFile(string& str, bool isdiff, string& original) {
+		//Only scr and loot have scopes to skip
+		lazy_generation = !isdiff && lazy_target && !diff.empty() && later_diffs.empty() && (filetype == FileType::scr || filetype == FileType::loot) && source_map.Valid();
 
 		switch (filetype) {
 		case FileType::scr:
-			if (!GenerateTreeScr(str_copy, isdiff)) {
+			if (!GenerateTreeScr(str, isdiff)) {
 				logger.Error("Failed to generate tree from <scr> file"sv);
 				HandleResets(isdiff);
 				return false;
 			}
 			break;
 		case FileType::def:
-			if (!GenerateTreeDef(str_copy, isdiff)) {
+			if (!GenerateTreeDef(str, isdiff)) {
 				logger.Error("Failed to generate tree from <def> file"sv);
 				HandleResets(isdiff);
 				return false;
 			}
 			break;
 		case FileType::loot:
-			if (!GenerateTreeLoot(str_copy, isdiff)) {
+			if (!GenerateTreeLoot(str, isdiff)) {
 				logger.Error("Failed to generate tree from <loot> file"sv);
 				HandleResets(isdiff);
 				return false;
 			}
 			break;
 		case FileType::varlist:
-			if (!GenerateTreeVarlist((str_copy + '_'), isdiff)) { //To work with things like ParseAttribute which weren't made with the assumption that a file could end in an attribute
+			str += '_'; //To work with things like ParseAttribute which weren't made with the assumption that a file could end in an attribute
+			if (!GenerateTreeVarlist(str, isdiff)) {
 				logger.Error("Failed to generate tree from <varlist.scr>"sv);
 				HandleResets(isdiff);
 				return false;
@@ -1033,12 +1816,24 @@ namespace StringParser {
 			return false;
 		}
 
+		if (!isdiff && !target_index.Build(target)) {
+			logger.Error("Failed to index target tree"sv);
+			HandleResets(isdiff);
+			return false;
+		}
+		if (!isdiff) {
+			target_source = std::move(original);
+		}
+		source_map.Clear();
+		structure.Clear();
+		lazy_generation = false;
+
 		return true;
 	}
 
 	[[nodiscard]] bool Parser::DeduceFileInfo(const string& firstline) {
 		//Varlist handling
-		auto pos = firstline.rfind('/');
+		auto pos = firstline.find_last_of("/\\");
 		string temp{ (pos >= firstline.length() ? firstline : firstline.substr(pos + 1)) };
 		RemoveTrailingWhitespace(temp); //Allow whitespace at end of line
 		if (StrICmp(temp.c_str(), "varlist.scr")) {
@@ -1076,16 +1871,52 @@ namespace StringParser {
 
 	[[nodiscard]] vector<Node>& Parser::GetVec(bool isdiff) noexcept { return (isdiff ? diff : target); }
 
+	//Records where a target node was written in the original target text so an untouched node can be copied instead of rendered. first and last index its first and last char in the preprocessed text.
+	bool Parser::MarkSourceSpan(Node& node, szt first, szt last, bool isdiff) const noexcept {
+		if (isdiff || !source_map.Valid()) {
+			return false;
+		}
+		const szt begin{ source_map.ToOriginal(first) }, end{ source_map.ToOriginal(last) + 1u };
+		if (begin < end && end <= std::numeric_limits<uint32>::max()) {
+			node.SetSourceSpan(static_cast<uint32>(begin), static_cast<uint32>(end));
+			return true;
+		}
+		return false;
+	}
+	//Lazy generation: leaves the scope opened at ts.index ungenerated and moves ts to its closing '}'. first indexes the first char of node's signature.
+	//Returns false without changing anything if the scope can't be skipped, in which case it must be generated.
+	[[nodiscard]] bool Parser::SkipScope(Node& node, szt first, traversal_state& ts) noexcept {
+		const szt close{ structure.Close(ts.index) };
+		if (close == StructuralIndex::NOT_FOUND) {
+			return false;
+		}
+		node.Set(Flag::Opaque);
+		if (!MarkSourceSpan(node, first, close, false)) {
+			node.Unset(Flag::Opaque);
+			return false;
+		}
+		node.UpdateHash();
+		ts.line += structure.NewlinesBetween(ts.index, close);
+		ts.index = close;
+		target_is_partial = true;
+		return true;
+	}
+
 	//Tree generation
 	[[nodiscard]] bool Parser::GenerateTreeScr(const string& str, bool isdiff) {
 		HandleResets(isdiff);
 
-		if (!ValidateBraces(str) || !ValidateParens(str)) {
+		if (!structure.Build(str)) {
+			logger.Error("Failed to index file structure"sv);
+			return false;
+		}
+		if (!ValidateBraces(structure) || !ValidateParens(structure)) {
 			logger.Error("Syntax error: brace or paren mismatch"sv);
 			return false;
 		}
 
 		traversal_state ts{ .line = (isdiff ? 2u : 1u) };
+		szt subStart{ 0u }, openBrace{ 0u };
 		{
 			//Handle import lines
 			if (!GenerateImportNodes(str, ts, isdiff)) {
@@ -1101,6 +1932,7 @@ namespace StringParser {
 
 			//Find main node signature
 			string subsig{};
+			subStart = ts.index;
 			if (!FindScrSub(str, ts, subsig)) {
 				logger.Error("Syntax error: Failed to find <sub X()> or signature incomplete"sv);
 				return false;
@@ -1140,6 +1972,7 @@ namespace StringParser {
 				logger.Error("Syntax error: <{}> must have a scope"sv, subsig);
 				return false;
 			}
+			openBrace = ts.index;
 			if (!SkipSpaceNewline(str, ts)) { //Make sure '{' isn't the last useful char
 				logger.Error("Syntax error: <{}> must have a complete scope"sv, subsig);
 				return false;
@@ -1157,10 +1990,23 @@ namespace StringParser {
 		}
 		//Main node scope handling
 		--ts.index; //Move a step back to work with GenerateScopeNodes
-		if (!GenerateScopeNodes(GetVec(isdiff).back(), str, ts, isdiff)) {
+		const Node* reach{ nullptr };
+		if (lazy_generation) {
+			//Skip the whole sub unless the diff reaches into it
+			const uint32 cmpID{ GetVec(isdiff).back().GetComparesigID() };
+			auto dNode{ std::find_if(diff.cbegin(), diff.cend(), [cmpID](const Node& node) noexcept { return node.GetComparesigID() == cmpID && !node.Any(Flag::Insert, Flag::Delete); }) };
+			if (dNode != diff.cend()) {
+				reach = &*dNode;
+			}
+			else if (traversal_state skip{ .index = openBrace, .line = ts.line }; SkipScope(GetVec(isdiff).back(), subStart, skip)) {
+				return true;
+			}
+		}
+		if (!GenerateScopeNodes(GetVec(isdiff).back(), str, ts, isdiff, reach)) {
 			logger.Error("Failed to parse <{}>'s contents"sv, string_cache.Find(diff.back().GetSigID()));
 			return false;
 		}
+		MarkSourceSpan(GetVec(isdiff).back(), subStart, ts.index, isdiff);
 
 		return true;
 	}
@@ -1168,7 +2014,11 @@ namespace StringParser {
 	[[nodiscard]] bool Parser::GenerateTreeDef(const string& str, bool isdiff) {
 		HandleResets(isdiff);
 
-		if (!ValidateParens(str)) {
+		if (!structure.Build(str)) {
+			logger.Error("Failed to index file structure"sv);
+			return false;
+		}
+		if (!ValidateParens(structure)) {
 			logger.Error("Syntax error: paren mismatch"sv);
 			return false;
 		}
@@ -1185,7 +2035,11 @@ namespace StringParser {
 	[[nodiscard]] bool Parser::GenerateTreeLoot(const string& str, bool isdiff) {
 		HandleResets(isdiff);
 
-		if (!ValidateBraces(str) || !ValidateParens(str)) {
+		if (!structure.Build(str)) {
+			logger.Error("Failed to index file structure"sv);
+			return false;
+		}
+		if (!ValidateBraces(structure) || !ValidateParens(structure)) {
 			logger.Error("Syntax error: brace or paren mismatch"sv);
 			return false;
 		}
@@ -1204,13 +2058,24 @@ namespace StringParser {
 			return false;
 		}
 
+		//Sub declarations the diff reaches into, by compare signature. Only these are generated when generating lazily.
+		std::unordered_map<uint32, const Node*> reached{};
+		if (lazy_generation) {
+			for (const auto& dNode : diff) {
+				if (!dNode.Any(Flag::Insert, Flag::Delete)) {
+					reached.emplace(dNode.GetComparesigID(), &dNode);
+				}
+			}
+		}
+
 		while (true) {
 			//Signature
+			const szt declStart{ ts.index };
 			szt aux{ ts.index };
 			string subsig{};
 			uint32 cmpID{ 0 };
 			if (!isdiff) {
-				ts.index = str.find(')', ts.index);
+				ts.index = structure.Next(ts.index, ')');
 				subsig = str.substr(aux, ts.index - aux + 1); //"sub X(...)"
 				if (!FormatAndValidateSubDeclSignature(subsig)) {
 					logger.Error("Syntax error: Invalid sub declaration <{}> at line {}"sv, subsig, ts.line);
@@ -1280,9 +2145,22 @@ namespace StringParser {
 			}
 
 			//Add children
-			if (!GenerateScopeNodes(GetVec(isdiff).back(), str, ts, isdiff)) {
-				logger.Error("Failed to parse <{}>'s contents (at line {})"sv, subsig, aux);
-				return false;
+			const Node* reach{ nullptr };
+			bool skipped{ false };
+			if (lazy_generation) {
+				if (auto it{ reached.find(cmpID) }; it != reached.end()) {
+					reach = it->second;
+				}
+				else {
+					skipped = SkipScope(GetVec(isdiff).back(), declStart, ts);
+				}
+			}
+			if (!skipped) {
+				if (!GenerateScopeNodes(GetVec(isdiff).back(), str, ts, isdiff, reach)) {
+					logger.Error("Failed to parse <{}>'s contents (at line {})"sv, subsig, aux);
+					return false;
+				}
+				MarkSourceSpan(GetVec(isdiff).back(), declStart, ts.index, isdiff);
 			}
 
 			//Find start of next sig after '}'
@@ -1295,7 +2173,11 @@ namespace StringParser {
 	[[nodiscard]] bool Parser::GenerateTreeVarlist(const string& str, bool isdiff) {
 		HandleResets(isdiff);
 
-		if (!ValidateParens(str)) {
+		if (!structure.Build(str)) {
+			logger.Error("Failed to index file structure"sv);
+			return false;
+		}
+		if (!ValidateParens(structure)) {
 			logger.Error("Syntax error: paren mismatch"sv);
 			return false;
 		}
@@ -1324,21 +2206,23 @@ namespace StringParser {
 			}
 
 			//Signature
+			const szt lineStart{ ts.index };
 			ts.index += 6; //Index of ' '
 			if (!SkipSpace(str, ts) || str[ts.index] != '"') {
 				logger.Error("Syntax error at line {}: import lines need to specify a string"sv, ts.line);
 				return false;
 			}
 			szt openq{ ts.index };
-			ts.index = str.find('"', ts.index + 1);
+			ts.index = structure.Next(ts.index + 1, '"');
 			if (ts.index >= str.length()) {
 				logger.Error("Syntax error at line {}: no closing <\"> for import line's string"sv, ts.line);
 				return false;
 			}
-			if (!allNotNewline(str.substr(openq + 1, ts.index - openq - 1))) {
+			if (structure.NewlinesBetween(openq + 1, ts.index) != 0u) {
 				logger.Error("Syntax error at line {}: string arguments cannot change lines"sv, ts.line);
 				return false;
 			}
+			const szt closeq{ ts.index };
 			string importSig{ "import " + str.substr(openq, ts.index - openq + 1) };
 			string importNewSig{ "" };
 			uint32 sigID{ string_cache.FindOrAdd(importSig) };
@@ -1365,12 +2249,12 @@ namespace StringParser {
 						return false;
 					}
 					openq = ts.index;
-					ts.index = str.find('"', ts.index + 1);
+					ts.index = structure.Next(ts.index + 1, '"');
 					if (ts.index >= str.length()) {
 						logger.Error("Syntax error at line {}: no closing <\"> for import declaration's rename string (while parsing <{}>)"sv, ts.line, importSig);
 						return false;
 					}
-					if (!allNotNewline(str.substr(openq + 1, ts.index - openq - 1))) {
+					if (structure.NewlinesBetween(openq + 1, ts.index) != 0u) {
 						logger.Error("Syntax error at line {}: string arguments cannot change lines (while parsing <{}>)"sv, ts.line, importSig);
 						return false;
 					}
@@ -1404,6 +2288,7 @@ namespace StringParser {
 					logger.Error("Unexpected error when trying to store import node data. Possibly out of memory? (while parsing <{}>)"sv, importSig);
 					return false;
 				}
+				MarkSourceSpan(GetVec(isdiff).back(), lineStart, closeq, isdiff);
 			}
 		}
 
@@ -1426,6 +2311,7 @@ namespace StringParser {
 			if (str.substr(ts.index, 7) != "export "s) {
 				return true;
 			}
+			const szt lineStart{ ts.index };
 			ts.index += 6; //Index of ' '
 			
 			//sig strings
@@ -1524,7 +2410,7 @@ namespace StringParser {
 				}
 				else if (type == 'str') {
 					aux = ts.index;
-					if (!ReadString(str, ts) && !ReadIdentifier(str, ts)) {
+					if (!ReadString(str, ts, structure) && !ReadIdentifier(str, ts)) {
 						logger.Error("Syntax error at line {}: expected a string or an identifier for <{}>'s {}value"sv, ts.line, id, decor);
 						return false;
 					}
@@ -1594,6 +2480,7 @@ namespace StringParser {
 				logger.Error("Syntax error at line {}: expected attributes or terminating <;> for <{}>"sv, ts.line, id);
 				return false;
 			}
+			const szt semicolon{ ts.index };
 
 			//Export end of line
 			bool finishedExport{ false };
@@ -1621,6 +2508,7 @@ namespace StringParser {
 					logger.Error("Unexpected error when trying to store <{}>'s export node data. Possibly out of memory?"sv, id);
 					return false;
 				}
+				MarkSourceSpan(GetVec(isdiff).back(), lineStart, semicolon, isdiff);
 			}
 		}
 
@@ -1633,7 +2521,8 @@ namespace StringParser {
 				return true;
 			}
 
-			szt aux{ str.find(')', ts.index) };
+			const szt sigStart{ ts.index };
+			szt aux{ structure.Next(ts.index, ')') };
 			if (aux >= str.length()) {
 				logger.Error("Syntax error at line {}: no closing <)> for varlist line"sv, ts.line);
 				return false;
@@ -1659,6 +2548,7 @@ namespace StringParser {
 				return false;
 			}
 			ts.index = aux;
+			const szt sigEnd{ aux };
 
 			uint32 sID{ string_cache.FindOrAdd(sig) };
 			if (sID == Cache::NULL_ID) {
@@ -1680,7 +2570,7 @@ namespace StringParser {
 					if (flags.Any(Flag::Rename)) {
 						if (lineType == 'inc') {
 							szt open{ ts.index };
-							if (!ReadString(str, ts)) {
+							if (!ReadString(str, ts, structure)) {
 								logger.Error("Syntax error at line {}: bad rename string of !include declaration"sv, ts.line);
 								return false;
 							}
@@ -1697,7 +2587,7 @@ namespace StringParser {
 								return false;
 							}
 							szt aux2{ ts.index };
-							ts.index = str.find(')', ts.index);
+							ts.index = structure.Next(ts.index, ')');
 							if (ts.index >= str.length()) {
 								logger.Error("Syntax error at line {}: rename signature missing <)>"sv, ts.line);
 								return false;
@@ -1738,6 +2628,7 @@ namespace StringParser {
 				logger.Error("Failed to store <{}> varlist node. Possibly out of memory?"sv);
 				return false;
 			}
+			MarkSourceSpan(GetVec(isdiff).back(), sigStart, sigEnd, isdiff);
 
 			//End of file?
 			traversal_state ts2{ ts };
@@ -1758,7 +2649,21 @@ namespace StringParser {
 		}
 	}
 	//Skips ' ' & newline chars and starts reading signature. Leaves ts.index pointing to the closing '}'
-	[[nodiscard]] bool Parser::GenerateScopeNodes(Node& parent_node, const string& str, traversal_state& ts, bool isdiff) noexcept {
+	//reach is the diff node matching parent_node when generating lazily, or nullptr to generate everything. Then only child scopes reach has a matching subnode for are generated.
+	[[nodiscard]] bool Parser::GenerateScopeNodes(Node& parent_node, const string& str, traversal_state& ts, bool isdiff, const Node* reach) noexcept {
+		std::unordered_map<uint32, const Node*> reached{};
+		if (reach) {
+			try {
+				for (NodeCIterator dChild{ reach->CBegin() }; dChild != reach->CEnd(); ++dChild) {
+					if (!dChild->Any(Flag::Insert, Flag::Delete)) {
+						reached.emplace(dChild->GetComparesigID(), &*dChild);
+					}
+				}
+			}
+			catch (...) {
+				reach = nullptr; //Generate everything instead
+			}
+		}
 		while (true) {
 			if (!SkipSpaceNewline(str, ts)) {
 				logger.Error("Syntax error: unexpected end of file"sv);
@@ -1766,6 +2671,7 @@ namespace StringParser {
 			}
 
 			if (str[ts.index] == '}') {
+				parent_node.UpdateHash(); //All children are final now
 				return true; //End of scope
 			}
 			if (!IsIdentifierChar(str[ts.index])) {
@@ -1775,7 +2681,8 @@ namespace StringParser {
 
 			//Signature
 			bool isUseStatement{ false };
-			szt aux{ str.find(')', ts.index) };
+			const szt sigStart{ ts.index };
+			szt aux{ structure.Next(ts.index, ')') };
 			if (aux >= str.length()) {
 				logger.Error("Syntax error at line {}: invalid signature for child of <{}>"sv, ts.line, string_cache.Find(parent_node.GetSigID()));
 				return false;
@@ -1819,7 +2726,7 @@ namespace StringParser {
 						logger.Error("Syntax error at line {}: <{}> has [rename] attribute but no valid signature identifier follows"sv, ts.line, sigStr);
 						return false;
 					}
-					szt endpos{ str.find(')', ts.index) };
+					szt endpos{ structure.Next(ts.index, ')') };
 					if (endpos >= str.length()) {
 						logger.Error("Syntax error at line {}: <{}> has [rename] attribute but following signature is missing parens"sv, ts.line, sigStr);
 						return false;
@@ -1865,6 +2772,7 @@ namespace StringParser {
 						logger.Error("Failed to add subnode <{}> to <{}>"sv, sigStr, string_cache.Find(parent_node.GetSigID()));
 						return false;
 					}
+					MarkSourceSpan(*std::prev(parent_node.End()), sigStart, ts.index, isdiff);
 				}
 				continue; //Child signature end
 			}
@@ -1875,10 +2783,20 @@ namespace StringParser {
 				}
 				flags.Set(isUseStatement ? Flag::Use : Flag::Function);
 				Node& child_node = parent_node.AddAndReturnSubnode({ sigID, newsigID, sigID, flags, sigID, ts.line });
-				if (!GenerateScopeNodes(child_node, str, ts, isdiff)) {
+				const Node* child_reach{ nullptr };
+				if (reach) {
+					if (auto it{ reached.find(sigID) }; it != reached.end()) {
+						child_reach = it->second;
+					}
+					else if (SkipScope(child_node, sigStart, ts)) {
+						continue; //Child left opaque
+					}
+				}
+				if (!GenerateScopeNodes(child_node, str, ts, isdiff, child_reach)) {
 					logger.Error("Failed to parse children of <{}> at line {}"sv, string_cache.Find(child_node.GetSigID()), ts.line);
 					return false;
 				}
+				MarkSourceSpan(child_node, sigStart, ts.index, isdiff);
 				continue; //Child children parsing end
 			}
 			else {
@@ -1927,6 +2845,30 @@ namespace StringParser {
 
 	//Tree parsing
 
+	//Dense ordersigID to base position table, reused across calls so ordering doesn't allocate a map per level. Every entry is NO_POSITION between calls.
+	static constexpr uint32 NO_POSITION{ std::numeric_limits<uint32>::max() };
+	[[nodiscard]] vector<uint32>& BasePositionTable() noexcept {
+		thread_local vector<uint32> table{};
+		return table;
+	}
+	//Resets the table entries of base's nodes of type on scope exit, including exceptions
+	class BasePositionReset final {
+	public:
+		BasePositionReset(vector<uint32>& table_, const vector<Node>& base_, Flag type_) noexcept : table(table_), base(base_), type(type_) {}
+		~BasePositionReset() noexcept {
+			for (const auto& node : base) {
+				if (node.Any(type) && node.GetOrdersigID() < table.size()) {
+					table[node.GetOrdersigID()] = NO_POSITION;
+				}
+			}
+		}
+	private:
+		vector<uint32>& table;
+		const vector<Node>& base;
+		Flag type;
+	};
+
+	//Orders the first contiguous run of nodes of type in vec: new nodes first in their current order, then nodes in base in base order. O(vec + base).
 	bool OrderNodesOfType(vector<Node>& vec, const vector<Node>& base, Flag type) {
 		if (vec.empty() || base.empty()) {
 			return true;
@@ -1935,95 +2877,80 @@ namespace StringParser {
 			logger.Error("Bad order flag <{}>"sv, static_cast<uint32>(type));
 			return false;
 		}
-		uint32 order{ 0 };
-		map<uint32, uint32> baseorder{};
 		//Get base order
+		vector<uint32>& position{ BasePositionTable() };
 		{
-			auto baseFirstNode{ base.cend() };
-			for (auto it{ base.cbegin() }; it != base.cend(); ++it) {
-				if (it->Any(type)) {
-					baseFirstNode = it;
-					break;
+			uint32 maxID{ 0 };
+			for (const auto& node : base) {
+				if (node.Any(type)) {
+					maxID = std::max(maxID, node.GetOrdersigID());
 				}
 			}
-			if (baseFirstNode != base.end()) {
-				for (auto it{ baseFirstNode }; it != base.cend(); ++it) {
-					if (it->Any(type)) {
-						if (!(baseorder.insert({ it->GetOrdersigID(), order++ })).second) {
-							logger.Warning("Failed to store base ordering to map. Possibly out of memory?");
-							return false;
-						}
-					}
+			if (maxID >= position.size()) {
+				position.resize(static_cast<szt>(maxID) + 1u, NO_POSITION);
+			}
+		}
+		BasePositionReset reset{ position, base, type };
+		uint32 numPositions{ 0 };
+		for (const auto& node : base) {
+			if (node.Any(type)) {
+				if (uint32& pos{ position[node.GetOrdersigID()] }; pos == NO_POSITION) {
+					pos = numPositions++;
+				}
+				else {
+					logger.Warning("Failed to store base ordering. Duplicate order signature in target?");
+					return false;
 				}
 			}
 		}
-		if (baseorder.empty()) {
+		if (numPositions == 0) {
 			return true; //No nodes of type in target so don't order
 		}
 
-		auto firstNode{ vec.end() };
-		for (auto it{ vec.begin() }; it != vec.end(); ++it) {
-			if (it->Any(type)) {
-				firstNode = it;
-				break;
-			}
-		}
+		auto firstNode{ std::find_if(vec.begin(), vec.end(), [type](const Node& node) noexcept { return node.Any(type); }) };
 		if (firstNode == vec.end()) {
 			return true; //Nothing to order
 		}
-		auto lastNode{ firstNode };
-		order = 0;
-		//Order the new nodes first and find last node
-		for (auto node{ firstNode }; node != vec.end(); ++node) {
-			if (!node->Any(type)) {
-				break;
-			}
-			lastNode = node;
-			if (!baseorder.contains(node->GetOrdersigID())) {
-				node->SetOrder(order++);
-			}
-		}
-		if (firstNode == lastNode) {
+		auto postLast{ std::find_if(firstNode, vec.end(), [type](const Node& node) noexcept { return !node.Any(type); }) };
+		if (postLast - firstNode < 2) {
 			return true; //No pointing ordering 1 node
 		}
-		//Order the remaining nodes in order of base but after new nodes
-		for (auto node{ firstNode }; node <= lastNode; ++node) {
-			if (auto it = baseorder.find(node->GetOrdersigID()); it != baseorder.end()) {
-				node->SetOrder(it->second + order);
+		auto positionOf = [&position](const Node& node) noexcept -> uint32 {
+			return node.GetOrdersigID() < position.size() ? position[node.GetOrdersigID()] : NO_POSITION;
+		};
+
+		//New nodes first, keeping their order
+		auto firstBase{ std::stable_partition(firstNode, postLast, [&positionOf](const Node& node) noexcept { return positionOf(node) == NO_POSITION; }) };
+		//Place the remaining nodes by base position, after new nodes
+		if (const szt numBase{ static_cast<szt>(postLast - firstBase) }; numBase > 1u) {
+			vector<szt> offsets(static_cast<szt>(numPositions) + 1u, 0u);
+			for (auto node{ firstBase }; node != postLast; ++node) {
+				++offsets[positionOf(*node) + 1u];
 			}
+			for (szt i{ 1u }; i < offsets.size(); ++i) {
+				offsets[i] += offsets[i - 1u];
+			}
+			vector<Node> placed(numBase);
+			for (auto node{ firstBase }; node != postLast; ++node) {
+				placed[offsets[positionOf(*node)]++] = std::move(*node);
+			}
+			std::move(placed.begin(), placed.end(), firstBase);
 		}
-		//Sort
-		auto postLast = lastNode;
-		++postLast;
-		std::sort(firstNode, postLast, [](const Node& lhs, const Node& rhs) noexcept { return lhs.GetOrder() < rhs.GetOrder(); });
 		return true;
 	}
+	//Stable three way partition: nodes of first type, then nodes of second type, then the rest. A node of both types counts as second type.
 	void SegregateNodesOfTypes(vector<Node>& vec, Flag firstType, Flag secondType) noexcept {
 		if (vec.empty()) {
 			return;
 		}
 
-		uint32 order{ 0 };
-		//Put nodes of first type first
-		for (auto& node : vec) {
-			if (node.Any(firstType)) {
-				node.SetOrder(order++);
-			}
-		}
-		//Put nodes of second type second
-		for (auto& node : vec) {
-			if (node.Any(secondType)) {
-				node.SetOrder(order++);
-			}
+		try {
+			auto second{ std::stable_partition(vec.begin(), vec.end(), [=](const Node& node) noexcept { return node.Any(firstType) && !node.Any(secondType); }) };
+			std::stable_partition(second, vec.end(), [=](const Node& node) noexcept { return node.Any(secondType); });
 		}
-		//Put other nodes last
-		for (auto& node : vec) {
-			if (!node.Any(firstType, secondType)) {
-				node.SetOrder(order++);
-			}
+		catch (...) {
+			logger.Error("Exception segregating nodes. Possibly out of memory?"sv);
 		}
-
-		std::sort(vec.begin(), vec.end(), [](const Node& lhs, const Node& rhs) noexcept { return lhs.GetOrder() < rhs.GetOrder();  });
 		return;
 	}
 
@@ -2054,37 +2981,83 @@ namespace StringParser {
 
 		return true;
 	}
+	//Orders a reused target subtree at every level, exactly like merging it child by child would have
+	bool OrderReusedSubtree(Node& node, const Cache& string_cache) {
+		if (node.GetNumSubnodes() == 0) {
+			return true;
+		}
+
+		//Ordering against itself is fine. Segregating keeps the relative order within each type, and the base order is fully read before anything moves.
+		if (!node.SegregateAndOrderSubnodes(node.GetSubnodesRef(), string_cache)) {
+			logger.Error("Failed to order reused funtion contents. Possibly out of memory?"sv);
+			return false;
+		}
+		for (NodeIterator child{ node.Begin() }; child != node.End(); ++child) {
+			if (!OrderReusedSubtree(*child, string_cache)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
 
 	
-	[[nodiscard]] bool Parser::ParseScrLoot(string& out) {
-		if (diff.empty() || target.empty()) {
-			logger.Error("Parsing error: parse requested but diff and target have not both been provided"sv);
-			return false;
+	//Records the comparesig path to every node under and including node that a diff operates on, and whether the operation replaces everything inside it
+	void CollectOperations(const Node& node, vector<uint32>& path, map<vector<uint32>, bool>& out) {
+		path.push_back(node.GetComparesigID());
+		if (node.Any(Flag::Insert, Flag::Rename, Flag::Redefine, Flag::Delete)) {
+			out.emplace(path, node.Any(Flag::Redefine, Flag::Delete));
+		}
+		for (NodeCIterator child{ node.CBegin() }; child != node.CEnd(); ++child) {
+			CollectOperations(*child, path, out);
 		}
+		path.pop_back();
+	}
+
+	//Whether merging dNode can add strings to the cache, which isn't safe from multiple threads
+	[[nodiscard]] bool MergeWritesCache(const Node& dNode) noexcept {
+		if (dNode.Any(Flag::Redefine) && dNode.Any(Flag::Export)) {
+			return true;
+		}
+		for (NodeCIterator child{ dNode.CBegin() }; child != dNode.CEnd(); ++child) {
+			if (MergeWritesCache(*child)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//Merge policies. Each supplies what differs per format so ParseFile's loop is specialized at compile time:
+	//	BeforeDiffNode()	runs before each top level diff node is handled
+	//	KeepLeftover()		whether a target node the diff didn't touch is appended after the diff
+	//	Order()				final ordering of the top level
+	template <>
+	struct Parser::MergePolicy<Parser::FileType::scr> {
+		static constexpr string_view name{ "scr/loot" };
+		static constexpr string_view tag{ "SL" };
+		static constexpr string_view leftover_name{ "sub declaration" };
 
-		vector<Node> result{};
-		result.reserve(target.size());
-		set<szt> usedTargetIndexes{};
 		bool importsDone{ false }, exportsDone{ false };
-		for (const auto& dNode : diff) {
-			//Append all import lines intact from target that weren't handled before moving to exports
+
+		//Append all import lines, then all export lines, intact from target that weren't handled before moving past them in the diff
+		[[nodiscard]] bool BeforeDiffNode(const Parser& parser, const Node& dNode, vector<Node>& result, vector<bool>& usedTargetIndexes) noexcept {
+			const vector<Node>& target{ *parser.merge_target };
 			if (!importsDone && !dNode.Any(Flag::Import)) {
 				for (szt i{ 0u }; i < target.size(); ++i) {
 					if (!target[i].Any(Flag::Import)) {
 						break;
 					}
-					else if (!usedTargetIndexes.contains(i) && !PushBackNoEx(result, target[i])) {
-						logger.Error("Unexpected error when trying to store unmodified import node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(target[i]), target[i].GetSourceLine());
+					else if (!usedTargetIndexes[i] && !PushBackNoEx(result, target[i])) {
+						logger.Error("Unexpected error when trying to store unmodified import node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, parser.CacheFindSig(target[i]), target[i].GetSourceLine());
 						return false;
 					}
-					usedTargetIndexes.insert(i);
+					usedTargetIndexes[i] = true;
 				}
 				importsDone = true;
 			}
-			//Append all export lines intact from target that weren't handled before moving to sub scope
 			if (!exportsDone && importsDone && !dNode.Any(Flag::Export)) {
 				for (szt i{ 0u }; i < target.size(); ++i) {
-					if (usedTargetIndexes.contains(i)) {
+					if (usedTargetIndexes[i]) {
 						continue;
 					}
 					else if (!target[i].Any(Flag::Export)) {
@@ -2092,16 +3065,78 @@ namespace StringParser {
 					}
 					else {
 						if (!PushBackNoEx(result, target[i])) {
-							logger.Error("Unexpected error when trying to store unmodified export node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(target[i]), target[i].GetSourceLine());
+							logger.Error("Unexpected error when trying to store unmodified export node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, parser.CacheFindSig(target[i]), target[i].GetSourceLine());
 							return false;
 						}
 					}
-					usedTargetIndexes.insert(i);
+					usedTargetIndexes[i] = true;
 				}
 				exportsDone = true;
 			}
+			return true;
+		}
+		[[nodiscard]] static bool KeepLeftover(const Node& tNode) noexcept { return tNode.Any(Flag::SubDeclaration); } //Loot only thing
+		[[nodiscard]] static bool Order(vector<Node>& result, const vector<Node>& target) {
+			return OrderNodesOfType(result, target, Flag::Import) && OrderNodesOfType(result, target, Flag::Export) && OrderNodesOfType(result, target, Flag::SubDeclaration);
+		}
+	};
+	//Loot and Scr are almost identical
+	template <>
+	struct Parser::MergePolicy<Parser::FileType::loot> : Parser::MergePolicy<Parser::FileType::scr> {};
+
+	template <>
+	struct Parser::MergePolicy<Parser::FileType::def> {
+		static constexpr string_view name{ "def" };
+		static constexpr string_view tag{ "D" };
+		static constexpr string_view leftover_name{ "export" };
+
+		[[nodiscard]] static constexpr bool BeforeDiffNode(const Parser&, const Node&, vector<Node>&, vector<bool>&) noexcept { return true; }
+		[[nodiscard]] static constexpr bool KeepLeftover(const Node&) noexcept { return true; }
+		[[nodiscard]] static bool Order(vector<Node>& result, const vector<Node>& target) {
+			return OrderNodesOfType(result, target, Flag::Export);
+		}
+	};
+
+	template <>
+	struct Parser::MergePolicy<Parser::FileType::varlist> {
+		static constexpr string_view name{ "varlist" };
+		static constexpr string_view tag{ "V" };
+		static constexpr string_view leftover_name{ "varlist" };
+
+		[[nodiscard]] static constexpr bool BeforeDiffNode(const Parser&, const Node&, vector<Node>&, vector<bool>&) noexcept { return true; }
+		[[nodiscard]] static bool KeepLeftover(const Node& tNode) noexcept { return tNode.Any(Flag::Include, Flag::Vardecl); }
+		[[nodiscard]] static bool Order(vector<Node>& result, const vector<Node>& target) {
+			SegregateNodesOfTypes(result, Flag::Include, Flag::Vardecl);
+			return OrderNodesOfType(result, target, Flag::Include) && OrderNodesOfType(result, target, Flag::Vardecl);
+		}
+	};
+
+	template <Parser::FileType type>
+	[[nodiscard]] bool Parser::ParseFile(const vector<Node>& diff_nodes, vector<Node>& result) {
+		using Policy = MergePolicy<type>;
+		const vector<Node>& target{ *merge_target };
+		if (diff_nodes.empty() || target.empty()) {
+			logger.Error("Parsing error: parse requested but diff and target have not both been provided"sv);
+			return false;
+		}
+
+		result.clear();
+		result.reserve(target.size());
+		vector<bool> usedTargetIndexes(target.size(), false); //Dense, indexed like target
+		struct MergeJob final {
+			szt resultIndex;
+			const Node* dNode;
+			const Node* tNode;
+			Location tLoc;
+		};
+		vector<MergeJob> jobs{};	//Matched pairs merged after matching when parallel_merge is set. Their result slots are reserved in order.
+		Policy policy{};
+		for (const auto& dNode : diff_nodes) {
+			if (!policy.BeforeDiffNode(*this, dNode, result, usedTargetIndexes)) {
+				return false;
+			}
 
-			//Delete is handled implicitly by not pushing anything back to result
+			//Noop and Delete are handled implicitly by not pushing anything back to result
 			if (dNode.Any(Flag::Insert)) { //Insert
 				if (!PushBackNoEx(result, dNode)) {
 					logger.Error("Unexpected error when trying to store insert node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(dNode), dNode.GetSourceLine());
@@ -2109,222 +3144,182 @@ namespace StringParser {
 				}
 			}
 			else {
-				szt tIdx{ 0u };
-				bool handled{ false };
-				for (const auto& tNode : target) {
-					if (dNode.GetComparesigID() == tNode.GetComparesigID()) {
-						if (usedTargetIndexes.contains(tIdx)) {
-							logger.Error("Error in file <{}>: <{}> was already operated on"sv, target_path, CacheFindSig(tNode));
+				if (const Location tLoc{ merge_index->Child(TargetIndex::ROOT, dNode.GetComparesigID()) }; tLoc != TargetIndex::NOT_FOUND) {
+					const szt tIdx{ merge_index->GetPosition(tLoc) };
+					const Node& tNode{ *merge_index->GetNode(tLoc) };
+					if (usedTargetIndexes[tIdx]) {
+						logger.Error("Error in file <{}>: <{}> was already operated on"sv, target_path, CacheFindSig(tNode));
+						return false;
+					}
+					if (!dNode.Any(Flag::Delete)) {
+						Node rNode{};
+						if (parallel_merge && !MergeWritesCache(dNode)) {
+							jobs.push_back({ result.size(), &dNode, &tNode, tLoc });
+						}
+						else if (!ParseNode(dNode, tNode, tLoc, rNode)) { //Rename / Redefine
+							logger.Error("Parsing error: HANDLE BAD XDDD"sv);
 							return false;
 						}
-						if (!dNode.Any(Flag::Delete)) {
-							Node rNode{};
-							if (!ParseNode(dNode, tNode, rNode)) { //Rename / Redefine
-								logger.Error("Parsing error: HANDLE BAD XDDD"sv);
-								return false;
-							}
-							rNode.SetOrderSigID(dNode.GetOrdersigID());
-							if (!PushBackNoEx(result, std::move(rNode))) {
-								logger.Error("Unexpected error when trying to store node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(dNode), dNode.GetSourceLine());
-								return false;
-							}
+						rNode.SetOrderSigID(dNode.GetOrdersigID());
+						if (!PushBackNoEx(result, std::move(rNode))) {
+							logger.Error("Unexpected error when trying to store node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(dNode), dNode.GetSourceLine());
+							return false;
 						}
-						handled = true;
-						usedTargetIndexes.insert(tIdx);
-						break;
 					}
-					++tIdx;
+					usedTargetIndexes[tIdx] = true;
 				}
-				if (!handled) {
-					if (dNode.Any(Flag::Delete)) {
-						logger.Warning("Parsing warning at line {}: node <{}> marked for deletion not found in target but this doesn't affect the output so parsing will continue"sv, dNode.GetSourceLine(), CacheFindSig(dNode));
-					}
-					else {
-						logger.Error("Parsing error at line {}: node <{}> not found in targetSL"sv, dNode.GetSourceLine(), CacheFindSig(dNode));
-						return false;
-					}
+				else if (dNode.Any(Flag::Delete)) {
+					logger.Warning("Parsing warning at line {}: node <{}> marked for deletion not found in target but this doesn't affect the output so parsing will continue"sv, dNode.GetSourceLine(), CacheFindSig(dNode));
+				}
+				else {
+					logger.Error("Parsing error at line {}: node <{}> not found in target{}"sv, dNode.GetSourceLine(), CacheFindSig(dNode), Policy::tag);
+					SuggestTargetLocation(dNode);
+					return false;
 				}
 			}
 		}
-		//Append all sub declaration lines from target that weren't handled		Loot only thing
+		//Merge the reserved pairs. Nothing touches result's size or the cache until all of them are done.
+		if (!ThreadPool::GetSingleton().Run(jobs.size(), [&](szt i) {
+			const MergeJob& job{ jobs[i] };
+			Node& rNode{ result[job.resultIndex] };
+			if (!ParseNode(*job.dNode, *job.tNode, job.tLoc, rNode)) { //Rename / Redefine
+				logger.Error("Parsing error: HANDLE BAD XDDD"sv);
+				return false;
+			}
+			rNode.SetOrderSigID(job.dNode->GetOrdersigID());
+			return true;
+		})) {
+			return false;
+		}
+		//Append all lines from target that weren't handled and the format keeps
 		for (szt i{ 0u }; i < target.size(); ++i) {
-			if (target[i].Any(Flag::SubDeclaration) && !usedTargetIndexes.contains(i) && !PushBackNoEx(result, target[i])) {
-				logger.Error("Unexpected error when trying to store unmodified sub declaration node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(target[i]), target[i].GetSourceLine());
+			if (Policy::KeepLeftover(target[i]) && !usedTargetIndexes[i] && !PushBackNoEx(result, target[i])) {
+				logger.Error("Unexpected error when trying to store unmodified {} node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, Policy::leftover_name, CacheFindSig(target[i]), target[i].GetSourceLine());
 				return false;
 			}
 		}
 
-		if (!OrderNodesOfType(result, target, Flag::Import) || !OrderNodesOfType(result, target, Flag::Export) || !OrderNodesOfType(result, target, Flag::SubDeclaration)) {
-			logger.Error("Failed to order scr/loot contents. Possibly out of memory?"sv);
+		if (!Policy::Order(result, target)) {
+			logger.Error("Failed to order {} contents. Possibly out of memory?"sv, Policy::name);
 			return false;
 		}
 
-		vector<string> resultStr(result.size());
-		for (szt i{ 0u }; i < result.size(); ++i) {
-			resultStr[i] = result[i].ToString(0, string_cache);
-		}
-		out = Join(resultStr, '\n');
 		return true;
 	}
 
-	[[nodiscard]] bool Parser::ParseDef(string& out) {
-		if (diff.empty() || target.empty()) {
-			logger.Error("Parsing error: parse requested but diff and target have not both been provided"sv);
-			return false;
-		}
-
-		vector<Node> result{};
-		result.reserve(target.size());
-		set<szt> usedTargetIndexes{};
-		for (const auto& dNode : diff) {
-			//Noop and Delete are handled implicitly by not pushing anything back to result
-			if (dNode.Any(Flag::Insert)) { //Insert
-				if (!PushBackNoEx(result, dNode)) {
-					logger.Error("Unexpected error when trying to store insert node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(dNode), dNode.GetSourceLine());
-					return false;
-				}
+	[[nodiscard]] bool Parser::MergeDiff(const vector<Node>& diff_nodes, vector<Node>& result) {
+		switch (filetype) {
+		case FileType::scr:
+			if (!ParseFile<FileType::scr>(diff_nodes, result)) {
+				logger.Error("Failed to parse <scr> file"sv);
+				return false;
 			}
-			else {
-				szt tIdx{ 0u };
-				bool handled{ false };
-				for (const auto& tNode : target) {
-					if (dNode.GetComparesigID() == tNode.GetComparesigID()) {
-						if (usedTargetIndexes.contains(tIdx)) {
-							logger.Error("Error in file <{}>: <{}> was already operated on"sv, target_path, CacheFindSig(tNode));
-							return false;
-						}
-						if (!dNode.Any(Flag::Delete)) {
-							Node rNode{};
-							if (!ParseNode(dNode, tNode, rNode)) { //Rename / Redefine
-								logger.Error("Parsing error: HANDLE BAD XDDD"sv);
-								return false;
-							}
-							rNode.SetOrderSigID(dNode.GetOrdersigID());
-							if (!PushBackNoEx(result, std::move(rNode))) {
-								logger.Error("Unexpected error when trying to store node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(dNode), dNode.GetSourceLine());
-								return false;
-							}
-						}
-						handled = true;
-						usedTargetIndexes.insert(tIdx);
-						break;
-					}
-					++tIdx;
-				}
-				if (!handled) {
-					if (dNode.Any(Flag::Delete)) {
-						logger.Warning("Parsing warning at line {}: node <{}> marked for deletion not found in target but this doesn't affect the output so parsing will continue"sv, dNode.GetSourceLine(), CacheFindSig(dNode));
-					}
-					else {
-						logger.Error("Parsing error at line {}: node <{}> not found in targetD"sv, dNode.GetSourceLine(), CacheFindSig(dNode));
-						return false;
-					}
-				}
+			return true;
+		case FileType::def:
+			if (!ParseFile<FileType::def>(diff_nodes, result)) {
+				logger.Error("Failed to parse <def> file"sv);
+				return false;
 			}
-		}
-		//Append all export lines from target that weren't handled
-		for (szt i{ 0u }; i < target.size(); ++i) {
-			if (!usedTargetIndexes.contains(i) && !PushBackNoEx(result, target[i])) {
-				logger.Error("Unexpected error when trying to store unmodified export node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(target[i]), target[i].GetSourceLine());
+			return true;
+		case FileType::loot:
+			if (!ParseFile<FileType::loot>(diff_nodes, result)) {
+				logger.Error("Failed to parse <loot> file"sv);
+				return false;
+			}
+			return true;
+		case FileType::varlist:
+			if (!ParseFile<FileType::varlist>(diff_nodes, result)) {
+				logger.Error("Failed to parse <varlist.scr>"sv);
 				return false;
 			}
+			return true;
+		default:
+			logger.Error("Invalid target filetype"sv);
+			return false;
 		}
+	}
 
-
-		if (!OrderNodesOfType(result, target, Flag::Export)) {
-			logger.Error("Failed to order def contents. Possibly out of memory?"sv);
+	//An added diff needs a diff before it, for the same target, whose target hasn't been generated lazily
+	[[nodiscard]] bool Parser::CheckAddedDiffTarget(const string& firstline) {
+		if (diff.empty()) {
+			logger.Error("A diff must be set before more are added"sv);
 			return false;
 		}
-
-		vector<string> resultStr(result.size());
-		for (szt i{ 0u }; i < result.size(); ++i) {
-			resultStr[i] = result[i].ToString(0, string_cache);
+		if (target_is_partial) {
+			logger.Error("Diffs can't be added after their target was generated lazily for the ones before them"sv);
+			return false;
 		}
-		out = Join(resultStr, '\n');
+		const string path{ target_path };
+		const FileType type{ filetype };
+		if (!DeduceFileInfo(firstline) || !PathICmp(target_path.c_str(), path.c_str())) {
+			logger.Error("Added diff doesn't target <{}>"sv, path);
+			target_path = path;
+			filetype = type;
+			return false;
+		}
+		target_path = path;
 		return true;
 	}
-
-	[[nodiscard]] bool Parser::ParseVarlist(string& out) {
-		if (diff.empty() || target.empty()) {
-			logger.Error("Parsing error: parse requested but diff and target have not both been provided"sv);
+	[[nodiscard]] bool Parser::QueueDiff(vector<Node>&& added) {
+		if (!CheckDiffConflicts(added)) {
 			return false;
 		}
+		later_diffs.push_back(std::move(added));
+		return true;
+	}
 
-		vector<Node> result{};
-		result.reserve(target.size());
-		set<szt> usedTargetIndexes{};
+	//Diffs for one target may not operate on the same node, or inside a node another one deletes or redefines, since the result would then depend on their order
+	[[nodiscard]] bool Parser::CheckDiffConflicts(const vector<Node>& added) const {
+		map<vector<uint32>, bool> earlier{}, later{};
+		vector<uint32> path{};
 		for (const auto& dNode : diff) {
-			//Noop and Delete are handled implicitly by not pushing anything back to result
-			if (dNode.Any(Flag::Insert)) { //Insert
-				if (!PushBackNoEx(result, dNode)) {
-					logger.Error("Unexpected error when trying to store insert node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(dNode), dNode.GetSourceLine());
-					return false;
-				}
-			}
-			else {
-				szt tIdx{ 0u };
-				bool handled{ false };
-				for (const auto& tNode : target) {
-					if (dNode.GetComparesigID() == tNode.GetComparesigID()) {
-						if (usedTargetIndexes.contains(tIdx)) {
-							logger.Error("Error in file <{}>: <{}> was already operated on"sv, target_path, CacheFindSig(tNode));
-							return false;
-						}
-						if (!dNode.Any(Flag::Delete)) {
-							Node rNode{};
-							if (!ParseNode(dNode, tNode, rNode)) { //Rename / Redefine
-								logger.Error("Parsing error: HANDLE BAD XDDD"sv);
-								return false;
-							}
-							rNode.SetOrderSigID(dNode.GetOrdersigID());
-							if (!PushBackNoEx(result, std::move(rNode))) {
-								logger.Error("Unexpected error when trying to store node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(dNode), dNode.GetSourceLine());
-								return false;
-							}
-						}
-						handled = true;
-						usedTargetIndexes.insert(tIdx);
-						break;
-					}
-					++tIdx;
-				}
-				if (!handled) {
-					if (dNode.Any(Flag::Delete)) {
-						logger.Warning("Parsing warning at line {}: node <{}> marked for deletion not found in target but this doesn't affect the output so parsing will continue"sv, dNode.GetSourceLine(), CacheFindSig(dNode));
-					}
-					else {
-						logger.Error("Parsing error at line {}: node <{}> not found in targetV"sv, dNode.GetSourceLine(), CacheFindSig(dNode));
-						return false;
-					}
-				}
-			}
+			CollectOperations(dNode, path, earlier);
 		}
-		//Append all varlist lines from target that weren't handled
-		for (szt i{ 0u }; i < target.size(); ++i) {
-			if (target[i].Any(Flag::Include, Flag::Vardecl) && !usedTargetIndexes.contains(i) && !PushBackNoEx(result, target[i])) {
-				logger.Error("Unexpected error when trying to store unmodified varlist node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(target[i]), target[i].GetSourceLine());
-				return false;
+		for (const auto& earlier_diff : later_diffs) {
+			for (const auto& dNode : earlier_diff) {
+				CollectOperations(dNode, path, earlier);
 			}
 		}
-
-		SegregateNodesOfTypes(result, Flag::Include, Flag::Vardecl);
-		if (!OrderNodesOfType(result, target, Flag::Include) || !OrderNodesOfType(result, target, Flag::Vardecl)) {
-			logger.Error("Failed to order varlist contents. Possibly out of memory?"sv);
-			return false;
+		for (const auto& dNode : added) {
+			CollectOperations(dNode, path, later);
 		}
 
-		vector<string> resultStr(result.size());
-		for (szt i{ 0u }; i < result.size(); ++i) {
-			resultStr[i] = result[i].ToString(0, string_cache);
+		bool ok{ true };
+		for (const auto& [operated, replaces] : later) {
+			bool conflicts{ false };
+			//The same node, or one inside a node an earlier diff replaces
+			for (szt length{ 1u }; length <= operated.size() && !conflicts; ++length) {
+				auto it{ earlier.find(vector<uint32>(operated.cbegin(), operated.cbegin() + length)) };
+				conflicts = it != earlier.end() && (length == operated.size() || it->second);
+			}
+			//A node inside one this diff replaces. Paths sharing a prefix sort right after it.
+			if (auto it{ earlier.upper_bound(operated) }; replaces && !conflicts && it != earlier.end()) {
+				conflicts = it->first.size() > operated.size() && std::equal(operated.cbegin(), operated.cend(), it->first.cbegin());
+			}
+			if (conflicts) {
+				string names{};
+				for (const uint32 id : operated) {
+					names += (names.empty() ? "" : " > ") + CacheFind(id);
+				}
+				logger.Error("Diff conflict in <{}>: <{}> is operated on by more than one diff"sv, target_path, names);
+				ok = false;
+			}
 		}
-		out = Join(resultStr, '\n');
-		return true;
+		return ok;
 	}
 
-	[[nodiscard]] bool Parser::ParseNode(const Node& dNode, const Node& tNode, Node& rNode) {
+	[[nodiscard]] bool Parser::ParseNode(const Node& dNode, const Node& tNode, Location tLoc, Node& rNode) {
 
 		//Being here means dNode has Noop AND/OR Rename AND/OR Redefine but NOT Insert OR Delete, and that tNode is its match
 
+		//dNode only restates tNode, so reuse tNode instead of matching and rebuilding the whole subtree
+		if (!dNode.Any(Flag::Rename, Flag::Redefine) && dNode.GetHash() == tNode.GetHash()) {
+			rNode = tNode;
+			rNode.SetComparesigID(dNode.GetComparesigID());
+			rNode.SetOrderSigID(dNode.GetOrdersigID());
+			return OrderReusedSubtree(rNode, string_cache);
+		}
+
 		rNode.SetComparesigID(dNode.GetComparesigID());
 		rNode.SetOrderSigID(dNode.GetOrdersigID());
 
@@ -2346,7 +3341,7 @@ namespace StringParser {
 				rNode.SetSigID(id);
 			}
 			else if (dNode.Any(Flag::SubScope, Flag::SubDeclaration, Flag::Function)) {
-				if (!rNode.SetSubnodes(dNode.GetSubnodes())) {
+				if (!rNode.SetSubnodes(dNode.SameSubnodes(tNode) ? tNode.GetSubnodes() : dNode.GetSubnodes())) { //Redefining to tNode's own contents reuses them
 					logger.Error("Parser error at line {}: unexpectedly failed to redefine <{}>'s subnodes"sv, dNode.GetSourceLine(), CacheFindSig(dNode));
 					return false;
 				}
@@ -2357,8 +3352,8 @@ namespace StringParser {
 			rNode.SetFlags(dNode.GetFlags());
 		}
 		else {
-			//No Redefine so handle dNode's children individualy like in ParseScrLoot
-			set<szt> usedTargetIndexes{};
+			//No Redefine so handle dNode's children individualy like in ParseFile
+			vector<bool> usedTargetIndexes(tNode.GetNumSubnodes(), false); //Dense, indexed like tNode's subnodes
 			for (NodeCIterator dChild{ dNode.CBegin() }; dChild != dNode.CEnd(); ++dChild) {
 				if (dChild->Any(Flag::Insert)) {
 					if (!rNode.AddSubnode(*dChild)) {
@@ -2367,47 +3362,41 @@ namespace StringParser {
 					}
 				}
 				else {
-					szt tIdx{ 0u };
-					bool handled{ false };
-					for (NodeCIterator tChild{ tNode.CBegin() }; tChild != tNode.CEnd(); ++tChild) {
-						if (dChild->GetComparesigID() == tChild->GetComparesigID()) {
-							if (usedTargetIndexes.contains(tIdx)) {
-								logger.Error("Error in file <{}>: <{}> was already operated on"sv, target_path, CacheFindSig(*tChild));
+					if (const Location cLoc{ merge_index->Child(tLoc, dChild->GetComparesigID()) }; cLoc != TargetIndex::NOT_FOUND) {
+						const szt tIdx{ merge_index->GetPosition(cLoc) };
+						const Node& tChild{ *merge_index->GetNode(cLoc) };
+						if (usedTargetIndexes[tIdx]) {
+							logger.Error("Error in file <{}>: <{}> was already operated on"sv, target_path, CacheFindSig(tChild));
+							return false;
+						}
+						if (!dChild->Any(Flag::Delete)) {
+							Node rChild{};
+							if (!ParseNode(*dChild, tChild, cLoc, rChild)) { //Rename / Redefine
+								logger.Error("Parsing error: HANDLE BAD XDDD"sv);
 								return false;
 							}
-							if (!dChild->Any(Flag::Delete)) {
-								Node rChild{};
-								if (!ParseNode(*dChild, *tChild, rChild)) { //Rename / Redefine
-									logger.Error("Parsing error: HANDLE BAD XDDD"sv);
-									return false;
-								}
-								rChild.SetOrderSigID(dChild->GetOrdersigID());
-								if (!rNode.AddSubnode(std::move(rChild))) {
-									logger.Error("Unexpected error when trying to store child node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(*dChild), dChild->GetSourceLine());
-									return false;
-								}
+							rChild.SetOrderSigID(dChild->GetOrdersigID());
+							if (!rNode.AddSubnode(std::move(rChild))) {
+								logger.Error("Unexpected error when trying to store child node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(*dChild), dChild->GetSourceLine());
+								return false;
 							}
-							handled = true;
-							usedTargetIndexes.insert(tIdx);
-							break;
 						}
-						++tIdx;
+						usedTargetIndexes[tIdx] = true;
 					}
-					if (!handled) {
-						if (dChild->Any(Flag::Delete)) {
-							logger.Warning("Parsing warning at line {}: node <{}> marked for deletion not found in target but this doesn't affect the output so parsing will continue"sv, dChild->GetSourceLine(), CacheFindSig(*dChild));
-						}
-						else {
-							logger.Error("Parsing error at line {}: node <{}> not found in targetN"sv, dChild->GetSourceLine(), CacheFindSig(*dChild));
-							return false;
-						}
+					else if (dChild->Any(Flag::Delete)) {
+						logger.Warning("Parsing warning at line {}: node <{}> marked for deletion not found in target but this doesn't affect the output so parsing will continue"sv, dChild->GetSourceLine(), CacheFindSig(*dChild));
+					}
+					else {
+						logger.Error("Parsing error at line {}: node <{}> not found in targetN"sv, dChild->GetSourceLine(), CacheFindSig(*dChild));
+						SuggestTargetLocation(*dChild);
+						return false;
 					}
 				}
 			}
 			//Append all lines from tNode that weren't handled
 			szt tIdx{ 0u };
 			for (NodeCIterator tChild{ tNode.CBegin() }; tChild != tNode.CEnd(); ++tChild) {
-				if (!usedTargetIndexes.contains(tIdx) && !rNode.AddSubnode(*tChild)) {
+				if (!usedTargetIndexes[tIdx] && !rNode.AddSubnode(*tChild)) {
 					logger.Error("Unexpected error when trying to store unmodified node parsed data. Possibly out of memory? (while parsing <{}> at line {})"sv, CacheFindSig(*tChild), tChild->GetSourceLine());
 					return false;
 				}
@@ -2423,22 +3412,111 @@ namespace StringParser {
 
 	
 
+	//Renders nodes joined by '\n' straight into out, sized up front so there's a single allocation. Nodes the merge left untouched are copied from the target text.
+	//Big outputs are sized and rendered in chunks on the thread pool, each node into its own slice of out given by the prefix sums of the sizes.
+	[[nodiscard]] bool Parser::Serialize(const vector<Node>& nodes, string& out) const {
+		static constexpr szt MIN_NODES_PER_CHUNK{ 256u };
+		static constexpr szt CHUNKS_PER_THREAD{ 4u }; //Some slack so a few huge subs don't leave threads idle
+
+		out.clear();
+		if (nodes.empty()) {
+			return true;
+		}
+		ThreadPool& pool{ ThreadPool::GetSingleton() };
+		const szt numChunks{ std::min((pool.Size() + 1u) * CHUNKS_PER_THREAD, nodes.size() / MIN_NODES_PER_CHUNK) };
+		if (numChunks <= 1u) {
+			szt size{ nodes.size() - 1u };
+			for (const auto& node : nodes) {
+				size += node.SerializedSize(0u, string_cache, *merge_source);
+			}
+			out.resize(size);
+
+			char* dest{ out.data() };
+			for (szt i{ 0u }; i < nodes.size(); ++i) {
+				if (i > 0u) {
+					*dest++ = '\n';
+				}
+				dest = nodes[i].SerializeTo(0u, string_cache, dest, *merge_source);
+			}
+			return true;
+		}
+
+		auto chunkBegin = [&](szt chunk) noexcept { return chunk * nodes.size() / numChunks; };
+		//offsets[i] is where node i starts, offsets[size] is the total
+		vector<szt> offsets(nodes.size() + 1u, 0u);
+		if (!pool.Run(numChunks, [&](szt chunk) noexcept {
+			for (szt i{ chunkBegin(chunk) }; i < chunkBegin(chunk + 1u); ++i) {
+				offsets[i + 1u] = nodes[i].SerializedSize(0u, string_cache, *merge_source) + 1u; //Counts the '\n' before the next node
+			}
+			return true;
+		})) {
+			logger.Error("Failed to size output for serialization"sv);
+			return false;
+		}
+		for (szt i{ 1u }; i < offsets.size(); ++i) {
+			offsets[i] += offsets[i - 1u];
+		}
+		out.resize(offsets.back() - 1u); //No '\n' after the last node
+
+		if (!pool.Run(numChunks, [&](szt chunk) noexcept {
+			for (szt i{ chunkBegin(chunk) }; i < chunkBegin(chunk + 1u); ++i) {
+				char* dest{ nodes[i].SerializeTo(0u, string_cache, out.data() + offsets[i], *merge_source) };
+				if (i + 1u < nodes.size()) {
+					*dest = '\n';
+				}
+			}
+			return true;
+		})) {
+			logger.Error("Failed to serialize output"sv);
+			return false;
+		}
+		return true;
+	}
+
 	[[nodiscard]] const string& Parser::CacheFindSig(const Node& node) const noexcept { return string_cache.Find(node.GetSigID()); }
 	[[nodiscard]] const string& Parser::CacheFind(uint32 id) const noexcept { return string_cache.Find(id); }
+	[[nodiscard]] string Parser::QualifiedPath(Location loc) const {
+		string result{};
+		for (; loc != TargetIndex::ROOT && loc != TargetIndex::NOT_FOUND; loc = merge_index->GetParent(loc)) {
+			result = (result.empty() ? CacheFindSig(*merge_index->GetNode(loc)) : CacheFindSig(*merge_index->GetNode(loc)) + " > " + result);
+		}
+		return result;
+	}
+	//Points at where the target does have dNode's signature, for diffs that got the nesting wrong
+	void Parser::SuggestTargetLocation(const Node& dNode) const noexcept {
+		try {
+			if (const Location loc{ merge_index->FindAnywhere(dNode.GetComparesigID()) }; loc != TargetIndex::NOT_FOUND) {
+				logger.Info("<{}> exists in target as <{}>. Check the diff's nesting."sv, CacheFindSig(dNode), QualifiedPath(loc));
+			}
+		}
+		catch (...) {
+			return;
+		}
+	}
 
 
 
 	void Parser::ResetImpl() noexcept {
 		diff.clear();
+		later_diffs.clear();
 		target.clear();
+		target_index.Clear();
+		target_source.clear();
+		target_is_partial = false;
 		string_cache.Reset();
 	}
 	void Parser::HandleResets(bool isdiff) noexcept {
-		if (isdiff) {
+		if (isdiff && adding_diff) {
+			diff.clear();
+		}
+		else if (isdiff) {
 			ResetImpl();
 		}
 		else {
 			target.clear();
+			target_index.Clear();
+			target_source.clear();
+			target_is_partial = false;
 		}
 	}
 
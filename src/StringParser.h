@@ -6,6 +6,11 @@
 #include "Utils.h"
 
 #include <mutex>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <utility>
 
 
 namespace StringParser {
@@ -37,6 +42,9 @@ namespace StringParser {
 				Function,
 				Include,
 				Vardecl,
+
+				//State flags
+				Opaque,		//Lazily generated target scope. Its subnodes were never generated, so it can only be copied from its source span as-is.
 			};
 			using NodeFlags = BitFlagsRaw<Flag>;
 
@@ -68,6 +76,8 @@ namespace StringParser {
 			void SetOrder(const uint32 neworder) noexcept;
 			void SetOrderSigID(const uint32 newid) noexcept;
 			void SetSourceLine(const uint64 newsourceline) noexcept;
+			void SetSourceSpan(const uint32 begin, const uint32 end) noexcept;
+			void UpdateHash() noexcept;
 
 			bool SegregateAndOrderSubnodes(const NodeVector& rhs, const Cache& string_cache) noexcept;
 
@@ -80,14 +90,18 @@ namespace StringParser {
 			[[nodiscard]] uint32 GetOrder() const noexcept;
 			[[nodiscard]] uint32 GetOrdersigID() const noexcept;
 			[[nodiscard]] uint64 GetSourceLine() const noexcept;
+			[[nodiscard]] std::pair<uint32, uint32> GetSourceSpan() const noexcept;
+			[[nodiscard]] uint64 GetHash() const noexcept;
+			[[nodiscard]] bool SameSubnodes(const Node& other) const noexcept;
+			[[nodiscard]] bool IsVerbatim(string_view source) const noexcept;
 
 			[[nodiscard]] NodeVector CopySubnodes() const;
 			[[nodiscard]] const NodeVector& GetSubnodesRef() const noexcept;
 
 			template<typename... Flags> requires(sizeof...(Flags) > 0 and (std::same_as<Flags, Flag> and ...))
-			void Set(Flags... vals) noexcept { return flags.Set(vals...); }
+			void Set(Flags... vals) noexcept { span_end = 0u; return flags.Set(vals...); }
 			template<typename... Flags> requires(sizeof...(Flags) > 0 and (std::same_as<Flags, Flag> and ...))
-			void Unset(Flags... vals) noexcept { return flags.Unset(vals...); }
+			void Unset(Flags... vals) noexcept { span_end = 0u; return flags.Unset(vals...); }
 			template<typename... Flags> requires(sizeof...(Flags) > 0 and (std::same_as<Flags, Flag> and ...))
 			[[nodiscard]] bool Any(Flags... vals) const noexcept { return flags.Any(vals...); }
 			template<typename... Flags> requires(sizeof...(Flags) > 0 and (std::same_as<Flags, Flag> and ...))
@@ -107,6 +121,10 @@ namespace StringParser {
 
 
 			[[nodiscard]] string ToString(szt depth, const Cache& string_cache) const;
+			//Exact length of SerializeTo()'s output
+			[[nodiscard]] szt SerializedSize(szt depth, const Cache& string_cache, string_view source = {}) const noexcept;
+			//Writes ToString()'s output to dest, which must fit SerializedSize(), except that verbatim subtrees are copied from source as they were written. Returns one past the last char written.
+			char* SerializeTo(szt depth, const Cache& string_cache, char* dest, string_view source = {}) const noexcept;
 			[[nodiscard]] string ToStringAttr(szt depth, const Cache& string_cache) const;
 
 		private:
@@ -116,16 +134,77 @@ namespace StringParser {
 			NodeFlags flags{};						//
 			uint32 ordersigID;						//
 			uint32 order{ 0 };						//
+			uint32 span_begin{ 0u };				//Byte span [span_begin, span_end) in the original target text. Empty if not from the target or edited since.
+			uint32 span_end{ 0u };					//
 			uint64 sourceline{ 0u };				//
+			uint64 hash{ 0u };						//Structural fingerprint of signature, operations, and subnode hashes. See UpdateHash().
 			NodeVector subnodes{};					//
+
+			[[nodiscard]] uint64 LeafHash() const noexcept;
+		};
+		static_assert(sizeof(Node) == 72u);
+
+		//Index from qualified signature paths (top-level comparesig -> child comparesig -> ...) to target nodes.
+		//Built in one pass after the target tree is generated, so any nested target node is found in O(path length). Invalidated by any change to the indexed tree.
+		class TargetIndex final {
+		public:
+			using Location = szt;
+			static constexpr Location ROOT{ 0u };		//The virtual parent of the top-level nodes
+			static constexpr Location NOT_FOUND{ std::numeric_limits<Location>::max() };
+
+			[[nodiscard]] bool Build(const vector<Node>& roots) noexcept;
+			void Clear() noexcept;
+
+			[[nodiscard]] Location Child(Location parent, uint32 comparesigID) const noexcept;	//First child of parent with comparesigID, like a linear search would find
+			[[nodiscard]] Location ChildAt(Location parent, szt position) const noexcept;
+			[[nodiscard]] Location Find(const vector<uint32>& path) const noexcept;
+			[[nodiscard]] Location FindAnywhere(uint32 comparesigID) const noexcept;			//First node with comparesigID at any depth, in pre-order
+			[[nodiscard]] const Node* GetNode(Location loc) const noexcept;
+			[[nodiscard]] Location GetParent(Location loc) const noexcept;
+			[[nodiscard]] szt GetPosition(Location loc) const noexcept;							//Position of loc among its siblings
+
+		private:
+			struct Entry final {
+			public:
+				const Node* node{ nullptr };
+				Location parent{ NOT_FOUND };
+				Location first_child{ NOT_FOUND };	//Siblings are stored contiguously
+			};
+
+			vector<Entry> entries{};
+			std::unordered_map<uint64, Location> children{};	//(parent << 32 | comparesigID) to first matching child
+			std::unordered_map<uint32, Location> anywhere{};
+
+			void AddChildren(Location parent, const vector<Node>& nodes);
 		};
-		static_assert(sizeof(Node) == 56u);
 		
 
 
+		//Stateless merging: trees are generated once and only read by Merge(), so one DiffTree can be merged into many TargetTrees at once,
+		//from any number of threads, and a TargetTree can be reused across diffs without parsing it again
+		class DiffTree;
+		class TargetTree;
+		class NodeStore;	//Shared storage TargetTrees can move their nodes into, to load many at once in less memory
+		[[nodiscard]] static bool Merge(const DiffTree& diff, const TargetTree& target, string& out) noexcept;
+
+		//The string&& overloads preprocess the text in place, so the file isn't copied. The const string& ones copy it once.
 		[[nodiscard]] bool SetDiff(const string& diff_str) noexcept;
-		[[nodiscard]] bool SetTarget(const string& diff_str) noexcept;
+		[[nodiscard]] bool SetDiff(string&& diff_str) noexcept;
+		[[nodiscard]] bool AddDiff(const string& diff_str) noexcept;	//Queues another diff for the same target, applied after the ones before it
+		[[nodiscard]] bool AddDiff(string&& diff_str) noexcept;
+		[[nodiscard]] bool SetDiffProgram(string_view program) noexcept;	//SetDiff() for a diff compiled with CompileDiff(). Skips all text processing. program can view a mapped file.
+		[[nodiscard]] bool AddDiffProgram(string_view program) noexcept;	//AddDiff() for a compiled diff
+		[[nodiscard]] bool CompileDiff(string& out) const noexcept;		//Writes the diff set with SetDiff() as a patch program. See PatchProgram.
+		[[nodiscard]] bool SetTarget(const string& target_str) noexcept;
+		[[nodiscard]] bool SetTarget(string&& target_str) noexcept;
+		using ChunkSink = std::function<bool(string_view)>;			//Takes the next chunk of a file. False stops reading.
+		using ChunkReader = std::function<bool(const ChunkSink&)>;	//Feeds a whole file to the sink in order, chunk by chunk
+		[[nodiscard]] bool StreamTarget(szt size_hint, const ChunkReader& read) noexcept;	//SetTarget() that preprocesses each chunk as soon as it's read
 		[[nodiscard]] string GetTargetPath() const;
+		[[nodiscard]] bool HasNetChanges() const noexcept;
+		[[nodiscard]] szt GetFileCopies() const noexcept;	//Whole-file copies made of diff and target texts since construction, counting the buffer StreamTarget() reads into
+		void SetParallelMerge(bool enable) noexcept;
+		void SetLazyTarget(bool enable) noexcept;
 
 		[[nodiscard]] bool Parse(string& out) noexcept;
 
@@ -148,12 +227,28 @@ namespace StringParser {
 		using Locker = std::lock_guard<std::mutex>;
 		mutable std::mutex lock{};
 		vector<Node> diff{};
+		vector<vector<Node>> later_diffs{};	//Diffs added with AddDiff(), applied in order after diff
 		vector<Node> target{};
 		string target_path{};
 		FileType filetype{ FileType::INVALID_FILETYPE };
 		Cache string_cache{};
-
-		[[nodiscard]] bool SetFile(const string& str, bool isdiff);
+		TargetIndex target_index{};
+		string target_source{};			//Original target text that target nodes' source spans point into
+		StringUtils::SourceMap source_map{};	//Maps preprocessed target text back to target_source while generating the target tree
+		//What merging reads of the target: the parser's own, or a TargetTree's that Merge() reads in place
+		const vector<Node>* merge_target{ &target };
+		const TargetIndex* merge_index{ &target_index };
+		const string* merge_source{ &target_source };
+		bool parallel_merge{ false };	//Merge matched top level nodes on the thread pool. Matching itself stays sequential.
+		bool lazy_target{ false };		//Only generate the target scopes the diff reaches. The diff must be set first.
+		bool lazy_generation{ false };	//Whether the target being generated right now is generated lazily
+		bool target_is_partial{ false };	//Target has Opaque nodes
+		StringUtils::StructuralIndex structure{};	//Structure of the file being generated
+		bool adding_diff{ false };		//Generating a diff for AddDiff(), which keeps the diffs and cache set before it
+		std::atomic<szt> file_copies{ 0u };	//See GetFileCopies(). Not cleared by Reset().
+
+		[[nodiscard]] bool SetFile(string& str, bool isdiff);	//Leaves str unspecified
+		[[nodiscard]] bool GenerateFile(string& str, bool isdiff, string& original);	//str is preprocessed. A target's original is moved to target_source.
 		[[nodiscard]] bool DeduceFileInfo(const string& firstline);
 
 		//Tree generating
@@ -164,19 +259,27 @@ namespace StringParser {
 		[[nodiscard]] bool GenerateImportNodes(const string& str, StringUtils::traversal_state& ts, bool isdiff) noexcept;
 		[[nodiscard]] bool GenerateExportNodes(const string& str, StringUtils::traversal_state& ts, bool isdiff) noexcept;
 		[[nodiscard]] bool GenerateVarlistNodes(const string& str, StringUtils::traversal_state& ts, bool isdiff) noexcept;
-		[[nodiscard]] bool GenerateScopeNodes(Node& parent_node, const string& str, StringUtils::traversal_state& ts, bool isdiff) noexcept;
+		[[nodiscard]] bool GenerateScopeNodes(Node& parent_node, const string& str, StringUtils::traversal_state& ts, bool isdiff, const Node* reach) noexcept;
+		[[nodiscard]] bool SkipScope(Node& node, szt first, StringUtils::traversal_state& ts) noexcept;
 		[[nodiscard]] bool IdentifyAttribute(const string& str, Node::Flag& out) const noexcept;
 		[[nodiscard]] bool ParseAttributes(const string& str, StringUtils::traversal_state& ts, Node::NodeFlags& out) const noexcept;
+		bool MarkSourceSpan(Node& node, szt first, szt last, bool isdiff) const noexcept;
 
 		//Tree parsing
-		[[nodiscard]] bool ParseScrLoot(string& out);
-		[[nodiscard]] bool ParseDef(string& out);
-		[[nodiscard]] bool ParseVarlist(string& out);
-		[[nodiscard]] bool ParseNode(const Node& dNode, const Node& tNode, Node& rNode);
+		template <FileType type> struct MergePolicy;			//Per format merge rules for ParseFile, specialized in StringParser.cpp
+		template <FileType type> [[nodiscard]] bool ParseFile(const vector<Node>& diff_nodes, vector<Node>& result);
+		[[nodiscard]] bool MergeDiff(const vector<Node>& diff_nodes, vector<Node>& result);
+		[[nodiscard]] bool CheckDiffConflicts(const vector<Node>& added) const;
+		[[nodiscard]] bool CheckAddedDiffTarget(const string& firstline);
+		[[nodiscard]] bool QueueDiff(vector<Node>&& added);
+		[[nodiscard]] bool ParseNode(const Node& dNode, const Node& tNode, TargetIndex::Location tLoc, Node& rNode);
+		[[nodiscard]] bool Serialize(const vector<Node>& nodes, string& out) const;
 
 		[[nodiscard]] vector<Node>& GetVec(bool isdiff) noexcept;
 		[[nodiscard]] const string& CacheFind(uint32 id) const noexcept;
 		[[nodiscard]] const string& CacheFindSig(const Node& node) const noexcept;
+		[[nodiscard]] string QualifiedPath(TargetIndex::Location loc) const;
+		void SuggestTargetLocation(const Node& dNode) const noexcept;
 
 		void ResetImpl() noexcept;
 		void HandleResets(bool isdiff) noexcept;
@@ -184,6 +287,111 @@ namespace StringParser {
 	};
 	//static_assert(sizeof(Parser) == 168u);
 
+	class Parser::DiffTree final {
+	public:
+		[[nodiscard]] bool Generate(const string& diff_str) noexcept;
+		[[nodiscard]] bool Generate(string&& diff_str) noexcept;
+		[[nodiscard]] bool Load(string_view program) noexcept;		//From a compiled diff. See PatchProgram.
+		[[nodiscard]] const string& GetTargetPath() const noexcept;
+
+	private:
+		friend class Parser;
+
+		vector<Node> nodes{};
+		Cache cache{};
+		string target_path{};
+		FileType filetype{ FileType::INVALID_FILETYPE };
+
+		[[nodiscard]] bool TakeFrom(Parser& parser);
+	};
+
+	//Hash-consed, immutable node storage. Structurally identical subtrees (same signatures, flags and child IDs) are stored once and
+	//referenced by ID, so targets that share use blocks, function bodies or variable blocks share their nodes too. Signatures are stored in
+	//the store's own cache, so trees from parsers with separate caches can share one store.
+	//
+	//Where a node was in its file is not part of it. Intern() hands back one Placement per node, in pre-order, for the tree to keep and give
+	//to Materialize().
+	//
+	//Any number of threads may call the const functions at once. Intern() and Clear() must not overlap with any other call.
+	class Parser::NodeStore final {
+	public:
+		using ID = uint32;
+		static constexpr ID NULL_ID{ std::numeric_limits<ID>::max() };
+
+		struct Placement final {
+		public:
+			uint32 span_begin{ 0u };
+			uint32 span_end{ 0u };
+			uint64 sourceline{ 0u };
+		};
+
+		[[nodiscard]] bool Intern(const vector<Node>& nodes, const Cache& nodes_cache, vector<ID>& ids, vector<Placement>& placements) noexcept;	//Appends to placements
+		[[nodiscard]] bool Materialize(const vector<ID>& ids, const vector<Placement>& placements, vector<Node>& out) const noexcept;	//out's signatures are IDs in Strings()
+		[[nodiscard]] const Cache& Strings() const noexcept;
+
+		[[nodiscard]] szt Size() const noexcept;			//Unique subtrees stored
+		[[nodiscard]] szt Interned() const noexcept;		//Nodes passed to Intern(), counting every subnode
+		[[nodiscard]] double DedupRatio() const noexcept;	//Interned() / Size()
+		[[nodiscard]] szt Bytes() const noexcept;			//Approximate heap use of the stored nodes and their lookup, not counting Strings()
+
+		void Clear() noexcept;
+
+	private:
+		struct Entry final {
+		public:
+			uint32 sigID{ Cache::NULL_ID };
+			uint32 newsigID{ Cache::NULL_ID };
+			uint32 comparesigID{ Cache::NULL_ID };
+			uint32 ordersigID{ Cache::NULL_ID };
+			Node::NodeFlags flags{};
+			uint32 first_child{ 0u };	//Into children
+			uint32 child_count{ 0u };
+		};
+
+		vector<Entry> entries{};
+		vector<ID> children{};	//Child IDs of every entry, each entry's contiguous
+		std::unordered_multimap<uint64, ID> lookup{};	//Entry hash to the IDs that have it
+		Cache strings{};
+		szt interned{ 0u };
+
+		[[nodiscard]] ID InternNode(const Node& node, const Cache& nodes_cache, std::unordered_map<uint32, uint32>& translation, vector<Placement>& placements);
+		[[nodiscard]] bool MaterializeNode(ID id, const vector<Placement>& placements, szt& next, Node& out) const;
+	};
+
+	class Parser::TargetTree final {
+	public:
+		TargetTree() noexcept = default;
+		TargetTree(TargetTree&&) noexcept = default;
+		TargetTree& operator=(TargetTree&&) noexcept = default;
+		TargetTree(const TargetTree&) = delete;				//index points into nodes
+		TargetTree& operator=(const TargetTree&) = delete;
+
+		//target_path is the path diffs name in their first line, which decides the format
+		[[nodiscard]] bool Generate(const string& target_path, const string& target_str) noexcept;
+		[[nodiscard]] bool Generate(const string& target_path, string&& target_str) noexcept;
+		[[nodiscard]] const string& GetTargetPath() const noexcept;
+
+		//Moves the nodes into store and keeps only their IDs and placements. Merge() then builds the nodes from store for each call, which
+		//trades time per merge for memory when many trees stay loaded. store must outlive the tree and not be interned into during a merge.
+		[[nodiscard]] bool Intern(NodeStore& store) noexcept;
+		[[nodiscard]] bool IsInterned() const noexcept;
+
+	private:
+		friend class Parser;
+
+		vector<Node> nodes{};	//Empty once interned
+		TargetIndex index{};
+		Cache cache{};
+		string source{};	//Original text, which nodes' source spans point into
+		string target_path{};
+		FileType filetype{ FileType::INVALID_FILETYPE };
+		const NodeStore* store{ nullptr };	//Set once interned
+		vector<NodeStore::ID> roots{};
+		vector<NodeStore::Placement> placements{};
+
+		[[nodiscard]] bool Materialize(vector<Node>& out, TargetIndex& out_index) const;	//Signatures are IDs in store's cache
+	};
+
 
 }
 
@@ -0,0 +1,130 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+
+//	ThreadPool::Batch
+
+class ThreadPool::Batch {
+public:
+	Batch(szt count_, const Job& job_) noexcept : count(count_), job(job_) {}
+
+	//Claims and runs jobs until none are left
+	void Work() noexcept {
+		for (szt i{ next.fetch_add(1u) }; i < count; i = next.fetch_add(1u)) {
+			if (!failed.load(std::memory_order_relaxed)) {
+				bool ok{ false };
+				try { ok = job(i); }
+				catch (...) { ok = false; }
+				if (!ok) {
+					failed.store(true, std::memory_order_relaxed);
+				}
+			}
+			Locker locker{ lock };
+			if (++finished == count) {
+				done.notify_all();
+			}
+		}
+	}
+	//Blocks until every job has finished, then returns whether all of them succeeded
+	[[nodiscard]] bool Wait() noexcept {
+		UniqueLocker locker{ lock };
+		done.wait(locker, [this]() noexcept { return finished == count; });
+		return !failed.load(std::memory_order_relaxed);
+	}
+
+private:
+	const szt count;
+	const Job& job;	//Outlives the batch's work since Run() waits for every job
+	std::atomic<szt> next{ 0u };
+	std::atomic<bool> failed{ false };
+	std::mutex lock{};
+	std::condition_variable done{};
+	szt finished{ 0u };
+};
+
+
+
+//	ThreadPool public
+
+ThreadPool& ThreadPool::GetSingleton() noexcept {
+	static ThreadPool pool{};
+	return pool;
+}
+
+[[nodiscard]] bool ThreadPool::Run(szt count, const Job& job) noexcept {
+	if (count == 0u) {
+		return true;
+	}
+	try {
+		auto batch{ std::make_shared<Batch>(count, job) };
+		//Wake a worker per job beyond the one this thread takes
+		if (const szt helpers{ std::min(count - 1u, workers.size()) }; helpers > 0u) {
+			{
+				Locker locker{ lock };
+				queue.insert(queue.end(), helpers, batch);
+			}
+			wake.notify_all();
+		}
+		batch->Work();
+		return batch->Wait();
+	}
+	catch (...) {
+		//Couldn't hand out the batch so run it here
+		bool ok{ true };
+		for (szt i{ 0u }; i < count && ok; ++i) {
+			try { ok = job(i); }
+			catch (...) { ok = false; }
+		}
+		return ok;
+	}
+}
+
+[[nodiscard]] szt ThreadPool::Size() const noexcept { return workers.size(); }
+
+
+
+//	ThreadPool private
+
+ThreadPool::ThreadPool() noexcept {
+	const unsigned hardware{ std::thread::hardware_concurrency() };
+	const szt count{ hardware > 1u ? static_cast<szt>(hardware - 1u) : 0u }; //The thread calling Run() makes up the last one
+	try {
+		workers.reserve(count);
+		for (szt i{ 0u }; i < count; ++i) {
+			workers.emplace_back([this]() noexcept { WorkerLoop(); });
+		}
+	}
+	catch (...) {
+		//Run with however many workers were started. Zero is fine too since Run() works on its own batch.
+	}
+}
+
+ThreadPool::~ThreadPool() noexcept {
+	{
+		Locker locker{ lock };
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers) {
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+}
+
+void ThreadPool::WorkerLoop() noexcept {
+	while (true) {
+		std::shared_ptr<Batch> batch{};
+		{
+			UniqueLocker locker{ lock };
+			wake.wait(locker, [this]() noexcept { return stopping || !queue.empty(); });
+			if (stopping && queue.empty()) {
+				return;
+			}
+			batch = std::move(queue.front());
+			queue.pop_front();
+		}
+		batch->Work();
+	}
+}
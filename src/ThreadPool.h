@@ -0,0 +1,46 @@
+#pragma once
+#include "Common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+//Fixed set of worker threads shared by the whole program. Work is submitted as a batch of indexed jobs and the submitting thread works on
+//the batch too, so a batch submitted from inside another batch's job still completes even when every worker is busy.
+class ThreadPool {
+public:
+	using Job = std::function<bool(szt)>;
+
+	static ThreadPool& GetSingleton() noexcept;
+
+	//Runs job(0) ... job(count - 1) and returns once all of them are done. Returns false if any job returned false or threw.
+	//After the first failure, jobs that haven't started yet are skipped.
+	[[nodiscard]] bool Run(szt count, const Job& job) noexcept;
+
+	[[nodiscard]] szt Size() const noexcept;	//Worker threads, not counting threads that call Run()
+
+private:
+	class Batch;
+	using Locker = std::lock_guard<std::mutex>;
+	using UniqueLocker = std::unique_lock<std::mutex>;
+
+	mutable std::mutex lock{};
+	std::condition_variable wake{};
+	deque<std::shared_ptr<Batch>> queue{};
+	vector<std::thread> workers{};
+	bool stopping{ false };
+
+	ThreadPool() noexcept;
+	~ThreadPool() noexcept;
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool(ThreadPool&&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	ThreadPool& operator=(ThreadPool&&) = delete;
+
+	void WorkerLoop() noexcept;
+};
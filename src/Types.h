@@ -127,6 +127,10 @@ public:
 
 	constexpr void Clear() noexcept { flags = base_t{ 0 }; }
 
+	constexpr base_t Raw() const noexcept { return flags; }
+
+	constexpr bool operator==(const BitFlagsRaw&) const noexcept = default;
+
 
 private:
 	base_t flags{};
@@ -1,6 +1,13 @@
 #include "Utils.h"
 #include "logger.h"
 #include <algorithm>
+#include <bit>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define STRUCTURAL_INDEX_SSE2
+#endif
 
 
 namespace StringUtils {
@@ -16,6 +23,284 @@ namespace StringUtils {
 	[[nodiscard]] bool IsSpaceNewline(const char c) noexcept { return c == ' ' || IsNewlineChar(c); }
 
 
+	//SourceMap
+	void SourceMap::BeginPass() noexcept {
+		try { passes.emplace_back(); }
+		catch (...) { valid = false; }
+	}
+	void SourceMap::Removed(szt pos, szt length) noexcept {
+		if (passes.empty()) {
+			valid = false;
+			return;
+		}
+		try {
+			auto& pass{ passes.back() };
+			pass.emplace_back(pos, (pass.empty() ? 0u : pass.back().second) + length);
+		}
+		catch (...) { valid = false; }
+	}
+	[[nodiscard]] szt SourceMap::ToOriginal(szt pos) const noexcept {
+		//Undo the last pass first
+		for (auto pass{ passes.crbegin() }; pass != passes.crend(); ++pass) {
+			auto after{ std::upper_bound(pass->cbegin(), pass->cend(), pos, [](szt p, const std::pair<szt, szt>& removal) noexcept { return p < removal.first; }) };
+			if (after != pass->cbegin()) {
+				pos += std::prev(after)->second;
+			}
+		}
+		return pos;
+	}
+	[[nodiscard]] bool SourceMap::Valid() const noexcept { return valid; }
+	void SourceMap::Clear() noexcept { passes.clear(); valid = true; }
+
+
+	//StructuralIndex
+	[[nodiscard]] bool StructuralIndex::Build(const string& str) noexcept {
+		Clear();
+		if (str.length() >= UNPAIRED) {
+			return false;
+		}
+		try {
+			vector<uint32> open_braces{};	//Indexes into positions[OpenBrace] of scopes not closed yet
+			bool paren_open{ false };
+			szt line{ 1u };
+			auto visit = [&](uint32 pos) {
+				const szt kind{ KindOf(str[pos]) };
+				positions[kind].push_back(pos);
+				switch (kind) {
+				case Newline:
+					++line;
+					break;
+				case OpenBrace:
+					open_braces.push_back(static_cast<uint32>(brace_close.size()));
+					brace_close.push_back(UNPAIRED);
+					break;
+				case CloseBrace:
+					if (brace_mismatch.kind != Mismatch::Kind::None) {
+						break; //Pairs past a mismatch would be wrong anyway
+					}
+					if (open_braces.empty()) {
+						brace_mismatch = { Mismatch::Kind::UnopenedBrace, line };
+						break;
+					}
+					brace_close[open_braces.back()] = pos;
+					open_braces.pop_back();
+					break;
+				case OpenParen:
+					paren_close.push_back(UNPAIRED);
+					if (paren_open && paren_mismatch.kind == Mismatch::Kind::None) {
+						paren_mismatch = { Mismatch::Kind::NestedParen, line };
+					}
+					paren_open = true;
+					break;
+				case CloseParen:
+					if (paren_mismatch.kind != Mismatch::Kind::None) {
+						break;
+					}
+					if (!paren_open) {
+						paren_mismatch = { Mismatch::Kind::UnopenedParen, line };
+						break;
+					}
+					paren_close.back() = pos;
+					paren_open = false;
+					break;
+				default:
+					break;
+				}
+			};
+
+			//Find structural chars 16 at a time and only visit those
+			szt pos{ 0u };
+#ifdef STRUCTURAL_INDEX_SSE2
+			const __m128i lbrace{ _mm_set1_epi8('{') }, rbrace{ _mm_set1_epi8('}') }, lparen{ _mm_set1_epi8('(') }, rparen{ _mm_set1_epi8(')') };
+			const __m128i quote{ _mm_set1_epi8('"') }, newline{ _mm_set1_epi8('\n') };
+			for (; pos + 16u <= str.length(); pos += 16u) {
+				const __m128i chunk{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + pos)) };
+				const __m128i braces{ _mm_or_si128(_mm_cmpeq_epi8(chunk, lbrace), _mm_cmpeq_epi8(chunk, rbrace)) };
+				const __m128i parens{ _mm_or_si128(_mm_cmpeq_epi8(chunk, lparen), _mm_cmpeq_epi8(chunk, rparen)) };
+				const __m128i others{ _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, newline)) };
+				for (uint32 mask{ static_cast<uint32>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(braces, parens), others))) }; mask != 0u; mask &= mask - 1u) {
+					visit(static_cast<uint32>(pos + std::countr_zero(mask)));
+				}
+			}
+#endif
+			for (; pos < str.length(); ++pos) {
+				if (KindOf(str[pos]) != KIND_COUNT) {
+					visit(static_cast<uint32>(pos));
+				}
+			}
+
+			if (brace_mismatch.kind == Mismatch::Kind::None && !open_braces.empty()) {
+				brace_mismatch = { Mismatch::Kind::UnclosedBrace, line };
+			}
+			if (paren_mismatch.kind == Mismatch::Kind::None && paren_open) {
+				paren_mismatch = { Mismatch::Kind::UnclosedParen, line };
+			}
+			return true;
+		}
+		catch (...) {
+			Clear();
+			return false;
+		}
+	}
+	[[nodiscard]] const StructuralIndex::Mismatch& StructuralIndex::BraceMismatch() const noexcept { return brace_mismatch; }
+	[[nodiscard]] const StructuralIndex::Mismatch& StructuralIndex::ParenMismatch() const noexcept { return paren_mismatch; }
+	[[nodiscard]] szt StructuralIndex::Close(szt open) const noexcept {
+		auto closeOf = [open](const vector<uint32>& opens, const vector<uint32>& closes) noexcept -> szt {
+			auto it{ std::lower_bound(opens.cbegin(), opens.cend(), open) };
+			if (it == opens.cend() || *it != open) {
+				return NOT_FOUND;
+			}
+			const uint32 close{ closes[static_cast<szt>(it - opens.cbegin())] };
+			return close == UNPAIRED ? NOT_FOUND : close;
+		};
+		const szt close{ closeOf(positions[OpenBrace], brace_close) };
+		return close != NOT_FOUND ? close : closeOf(positions[OpenParen], paren_close);
+	}
+	[[nodiscard]] szt StructuralIndex::Next(szt pos, char c) const noexcept {
+		const szt kind{ KindOf(c) };
+		if (kind == KIND_COUNT || pos >= UNPAIRED) {
+			return NOT_FOUND;
+		}
+		auto it{ std::lower_bound(positions[kind].cbegin(), positions[kind].cend(), static_cast<uint32>(pos)) };
+		return it != positions[kind].cend() ? *it : NOT_FOUND;
+	}
+	[[nodiscard]] szt StructuralIndex::NewlinesBetween(szt first, szt last) const noexcept {
+		if (first >= last) {
+			return 0u;
+		}
+		const auto& newlines{ positions[Newline] };
+		auto lower = [&newlines](szt pos) noexcept { return std::lower_bound(newlines.cbegin(), newlines.cend(), static_cast<uint32>(std::min<szt>(pos, UNPAIRED))); };
+		return static_cast<szt>(lower(last) - lower(first));
+	}
+	void StructuralIndex::Clear() noexcept {
+		for (auto& kind : positions) {
+			kind.clear();
+		}
+		brace_close.clear();
+		paren_close.clear();
+		brace_mismatch = {};
+		paren_mismatch = {};
+	}
+	[[nodiscard]] szt StructuralIndex::KindOf(char c) noexcept {
+		switch (c) {
+		case '{': return OpenBrace;
+		case '}': return CloseBrace;
+		case '(': return OpenParen;
+		case ')': return CloseParen;
+		case '"': return Quote;
+		case '\n': return Newline;
+		default: return KIND_COUNT;
+		}
+	}
+
+
+	//Preprocessor
+	Preprocessor::Preprocessor(string& out_, SourceMap* removed_) noexcept : out(out_), removed(removed_) {
+		if (removed) {
+			removed->BeginPass();
+		}
+	}
+	[[nodiscard]] bool Preprocessor::Feed(string_view chunk) noexcept {
+		try {
+			szt pos{ 0u };
+			while (pos < chunk.size()) {
+				//Copy runs of plain code straight through
+				if (!in_block && !in_line && held_block_slash == NONE && held_line_slash == NONE) {
+					const szt stop{ std::min(chunk.find_first_of("/\t", pos), chunk.size()) };
+					if (stop > pos) {
+						Emit(chunk[pos], consumed + pos);
+						out.append(chunk.substr(pos + 1u, stop - pos - 1u));
+						pos = stop;
+						continue;
+					}
+				}
+				BlockStage(chunk[pos], consumed + pos);
+				++pos;
+			}
+			consumed += chunk.size();
+			return true;
+		}
+		catch (...) {
+			return false;
+		}
+	}
+	[[nodiscard]] bool Preprocessor::Finish() noexcept {
+		try {
+			//Unclosed comments run to the end. A held '/' starts nothing.
+			if (held_block_slash != NONE) {
+				LineStage('/', std::exchange(held_block_slash, NONE));
+			}
+			if (held_line_slash != NONE) {
+				Emit('/', std::exchange(held_line_slash, NONE));
+			}
+			if (removed && consumed - out.size() != offset) {
+				removed->Removed(out.size(), consumed - out.size() - offset);
+				offset = consumed - out.size();
+			}
+			return true;
+		}
+		catch (...) {
+			return false;
+		}
+	}
+	//Like RemoveComments(), a block comment ends at the first "*/" after its "/*", and a "/*" can start inside a line comment
+	void Preprocessor::BlockStage(char c, szt pos) {
+		if (in_block) {
+			if (block_star && c == '/') {
+				in_block = false;
+				block_star = false;
+			}
+			else {
+				block_star = (c == '*');
+			}
+			return;
+		}
+		if (held_block_slash != NONE) {
+			if (c == '*') {
+				held_block_slash = NONE;
+				in_block = true;
+				return;
+			}
+			LineStage('/', std::exchange(held_block_slash, NONE));
+		}
+		if (c == '/') {
+			held_block_slash = pos;
+			return;
+		}
+		LineStage(c, pos);
+	}
+	//A line comment ends before its newline, which is kept
+	void Preprocessor::LineStage(char c, szt pos) {
+		if (in_line) {
+			if (c == '\n') {
+				in_line = false;
+				Emit(c, pos);
+			}
+			return;
+		}
+		if (held_line_slash != NONE) {
+			if (c == '/') {
+				held_line_slash = NONE;
+				in_line = true;
+				return;
+			}
+			Emit('/', std::exchange(held_line_slash, NONE));
+		}
+		if (c == '/') {
+			held_line_slash = pos;
+			return;
+		}
+		Emit(c, pos);
+	}
+	void Preprocessor::Emit(char c, szt pos) {
+		if (removed && pos - out.size() != offset) {
+			removed->Removed(out.size(), pos - out.size() - offset);
+			offset = pos - out.size();
+		}
+		out += (c == '\t' ? ' ' : c);
+	}
+
+
 	//Misc lambda-like helpers
 	[[nodiscard]] bool allWordChar(const string& str) noexcept {
 		for (const char c : str) if (!IsWordChar(c)) return false;
@@ -99,6 +384,14 @@ namespace StringUtils {
 		}
 		return (*c1 - *c2) == 0;
 	}
+	[[nodiscard]] bool PathICmp(const char* c1, const char* c2) noexcept {
+		auto fold = [](char c) { return c == '\\' ? '/' : static_cast<char>(std::tolower(static_cast<unsigned char>(c))); };
+		while (*c1 && fold(*c1) == fold(*c2)) {
+			++c1;
+			++c2;
+		}
+		return fold(*c1) == fold(*c2);
+	}
 	[[nodiscard]] bool SkipChars(const string& str, traversal_state& ts, bool(*func)(const char, szt&)) noexcept {
 		if (ts.index >= str.npos || ts.index + 1u >= str.length())
 			return false;
@@ -135,8 +428,37 @@ namespace StringUtils {
 	void RemoveLeadingAndTrailingWhitespace(string& str) noexcept { RemoveLeadingWhitespace(str); RemoveTrailingWhitespace(str); }
 	bool RemoveWhitespace(string& str) noexcept { try { std::erase_if(str, IsWhitespace); return true; } catch (...) { return false; } }
 	bool RemoveSpace(string& str) noexcept { try { std::erase_if(str, [](const char c) { return c == ' '; }); return true; } catch (...) { return false; } }
-	void RemoveComments(string& str) noexcept {
+	void CollapseCRLF(string& str, szt first) noexcept {
+		szt in{ str.find('\r', first) };
+		if (in == string::npos) {
+			return;
+		}
+		szt out{ in };
+		for (; in < str.length(); ++in) {
+			if (str[in] != '\r' || in + 1u == str.length() || str[in + 1u] != '\n') {
+				str[out++] = str[in];
+			}
+		}
+		str.erase(out);
+	}
+	void ExpandLF(string& str) {
+		const szt newlines{ static_cast<szt>(std::count(str.cbegin(), str.cend(), '\n')) };
+		if (newlines == 0u) {
+			return;
+		}
+		szt in{ str.length() };
+		str.resize(in + newlines);
+		for (szt out{ str.length() }; in > 0u;) { //Back to front, so nothing is overwritten before it's moved
+			const char c{ str[--in] };
+			str[--out] = c;
+			if (c == '\n') {
+				str[--out] = '\r';
+			}
+		}
+	}
+	void RemoveComments(string& str, SourceMap* removed) noexcept {
 		//Block
+		if (removed) { removed->BeginPass(); }
 		szt startpos{ 0u };
 		while (true) {
 			startpos = str.find("/*", startpos);
@@ -145,12 +467,15 @@ namespace StringUtils {
 			}
 			szt endpos{ str.find("*/", startpos + 2) }; //Start from after '*'. find() won't throw, just return npos if offset bad.
 			if (endpos >= str.length()) {
+				if (removed) { removed->Removed(startpos, str.length() - startpos); }
 				str = str.substr(0u, startpos);
 				break;
 			}
+			if (removed) { removed->Removed(startpos, endpos + 2 - startpos); }
 			str = str.substr(0u, startpos) + str.substr(endpos + 2); //endpos + 2 can at most be str.length(), aka the null terminator, and substr works with it.
 		}
 		//Line
+		if (removed) { removed->BeginPass(); }
 		startpos = 0;
 		while (true) {
 			startpos = str.find("//", startpos);
@@ -158,9 +483,11 @@ namespace StringUtils {
 				return;
 			szt endpos{ str.find('\n', startpos) };
 			if (endpos >= str.length()) {
+				if (removed) { removed->Removed(startpos, str.length() - startpos); }
 				str = str.substr(0u, startpos);
 				return;
 			}
+			if (removed) { removed->Removed(startpos, endpos - startpos); }
 			str = str.substr(0u, startpos) + str.substr(endpos);
 		}
 	}
@@ -29,12 +29,103 @@ namespace StringUtils {
 	[[nodiscard]] bool allNotNewline(const string& str) noexcept;
 
 
+	//Maps positions in a string that had ranges removed from it back to positions in the string before any removal.
+	//Removals are recorded in passes. Within a pass they must be recorded left to right, at their position in the string as it is at that point.
+	class SourceMap final {
+	public:
+		void BeginPass() noexcept;
+		void Removed(szt pos, szt length) noexcept;
+		[[nodiscard]] szt ToOriginal(szt pos) const noexcept;
+		[[nodiscard]] bool Valid() const noexcept;		//False if recording a removal failed, in which case ToOriginal() can't be trusted
+		void Clear() noexcept;
+
+	private:
+		vector<vector<std::pair<szt, szt>>> passes{};	//Per pass: position a removal happened at, and how much the pass removed up to and including it
+		bool valid{ true };
+	};
+
+
+	//Index of where every '{', '}', '(', ')', '"' and newline of a string is, with brackets paired up, so generation can jump to boundaries instead of scanning for them.
+	//Brackets count wherever they are, strings included, the same way the syntax checks always counted them.
+	class StructuralIndex final {
+	public:
+		static constexpr szt NOT_FOUND{ static_cast<szt>(-1) };
+
+		//First bracket mismatch found by Build()
+		struct Mismatch final {
+		public:
+			enum class Kind : uint8 {
+				None,
+				UnopenedBrace,
+				UnclosedBrace,
+				NestedParen,
+				UnopenedParen,
+				UnclosedParen,
+			};
+			Kind kind{ Kind::None };
+			szt line{ 0u };		//Line of the offending char counting from 1, or the last line for unclosed ones
+		};
+
+		[[nodiscard]] bool Build(const string& str) noexcept;		//False if str couldn't be indexed at all. Mismatched brackets still index fine.
+		[[nodiscard]] const Mismatch& BraceMismatch() const noexcept;
+		[[nodiscard]] const Mismatch& ParenMismatch() const noexcept;	//Parens don't nest
+		[[nodiscard]] szt Close(szt open) const noexcept;			//Index of the '}' or ')' closing the '{' or '(' at open, or NOT_FOUND
+		[[nodiscard]] szt Next(szt pos, char c) const noexcept;		//Index of the first structural char c at or after pos, or NOT_FOUND
+		[[nodiscard]] szt NewlinesBetween(szt first, szt last) const noexcept;	//Newlines in [first, last)
+		void Clear() noexcept;
+
+	private:
+		enum Kind : uint8 { OpenBrace, CloseBrace, OpenParen, CloseParen, Quote, Newline, KIND_COUNT };
+		static constexpr uint32 UNPAIRED{ static_cast<uint32>(-1) };
+
+		array<vector<uint32>, KIND_COUNT> positions{};	//Sorted
+		vector<uint32> brace_close{};	//Closing '}' of each '{' in positions[OpenBrace], or UNPAIRED
+		vector<uint32> paren_close{};	//Closing ')' of each '(' in positions[OpenParen], or UNPAIRED
+		Mismatch brace_mismatch{};
+		Mismatch paren_mismatch{};
+
+		[[nodiscard]] static szt KindOf(char c) noexcept;
+	};
+
+
+	//RemoveComments() followed by TabToSpace() in a single pass over text that may arrive in chunks, so a file can be preprocessed while it's
+	//still being read. Text is appended to out. Removals are recorded to the source map as one pass, mapping every kept char to the same
+	//original position the two passes of RemoveComments() would.
+	class Preprocessor final {
+	public:
+		explicit Preprocessor(string& out_, SourceMap* removed_ = nullptr) noexcept;
+
+		[[nodiscard]] bool Feed(string_view chunk) noexcept;
+		[[nodiscard]] bool Finish() noexcept;		//Call once after the last chunk
+
+	private:
+		static constexpr szt NONE{ static_cast<szt>(-1) };
+
+		string& out;
+		SourceMap* removed;
+		szt consumed{ 0u };			//Original position of the next char fed
+		szt offset{ 0u };			//Original position minus output position of the last char emitted
+		//Block comment stage
+		bool in_block{ false };
+		bool block_star{ false };	//Last char in the block comment was '*'
+		szt held_block_slash{ NONE };	//Original position of a '/' that may start a block comment
+		//Line comment stage, fed by the block comment stage
+		bool in_line{ false };
+		szt held_line_slash{ NONE };	//Original position of a '/' that may start a line comment
+
+		void BlockStage(char c, szt pos);
+		void LineStage(char c, szt pos);
+		void Emit(char c, szt pos);
+	};
+
+
 	//Utils
 	[[nodiscard]] vector<string> Split(const string& str, char delim, void(*formatter)(string&) = [](string&) {}, bool(*validator)(const string&) = [](const string&) { return true; });
 	[[nodiscard]] string Join(const vector<string>& vec, char delim);
 	[[nodiscard]] string Join(const vector<string>& vec1, const vector<string>& vec2, char delim);
 
 	[[nodiscard]] bool StrICmp(const char* c1, const char* c2) noexcept;
+	[[nodiscard]] bool PathICmp(const char* c1, const char* c2) noexcept;	//StrICmp() that also treats '\\' and '/' as equal
 	[[nodiscard]] bool SkipChars(const string& str, traversal_state& ts, bool(*func)(const char, szt&)) noexcept;
 	[[nodiscard]] bool SkipSpace(const string& str, traversal_state& ts) noexcept;
 	[[nodiscard]] bool SkipWhitespace(const string& str, traversal_state& ts) noexcept;
@@ -48,7 +139,9 @@ namespace StringUtils {
 	void RemoveLeadingAndTrailingWhitespace(string& str) noexcept;
 	bool RemoveWhitespace(string& str) noexcept;
 	bool RemoveSpace(string& str) noexcept;
-	void RemoveComments(string& str) noexcept;
+	void CollapseCRLF(string& str, szt first = 0u) noexcept;	//Drops the '\r' of each "\r\n" from first on, in place. A '\r' ending str is kept, as its '\n' may not be read yet.
+	void ExpandLF(string& str);	//Writes each '\n' as "\r\n", in place, like a file opened in text mode on Windows
+	void RemoveComments(string& str, SourceMap* removed = nullptr) noexcept;
 	bool TabToSpace(string& str) noexcept;
 }
 
@@ -65,6 +158,13 @@ namespace MiscUtils {
 		catch (...) { return false; }
 	}
 
+	//Order-dependent 64bit mix of value into seed. Used for node fingerprints, so it must stay deterministic across runs.
+	[[nodiscard]] constexpr uint64 HashCombine(uint64 seed, uint64 value) noexcept {
+		value *= 0xff51afd7ed558ccdull;
+		value ^= value >> 33;
+		return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+	}
+
 }
 
 
@@ -3,10 +3,10 @@
 #include "logger.h"
 #include "StringParser.h"
 #include "ConsoleHandler.h"
+#include "MappedFile.h"
 
 
 #include <fstream>
-#include <sstream>
 #include <iostream>
 using std::cout;
 
@@ -41,42 +41,37 @@ int main(int argc, char** argv) {
 	string baseName{ "dw_weather_def.scr" };
 	cout << "Parsing <" << baseName << "> with <" << baseName << ".txt> ...\n";
 
-	//std::ifstream fs(string{ baseName + ".txt" });
-	std::ifstream fs(baseName + ".txt");
-	if (!fs.is_open()) {
+	MappedFile fs{};
+	if (!fs.Open(baseName + ".txt")) {
 		std::cout << "\nFailed to open " << baseName << ".txt";
 		system("pause");
 		return -1;
 	}
-	std::stringstream ss{};
-	ss << fs.rdbuf();
-	const string difftext = ss.str();
-	fs.close();
+	string difftext = fs.Text();
+	fs.Close();
 
 	//logger.Info("\n\n\tINPUT DIFF: <\n{}\n>"sv, difftext);
 
 	StringParser::Parser parser{};
-	if (!parser.SetDiff(difftext))
+	if (!parser.SetDiff(std::move(difftext)))
 		std::cout << "\nparser.SetDiff() failed!\n";
 	else
 		std::cout << "\nparser.SetDiff() succeeded!\n";
 
 	
-	std::ifstream fs2(baseName);
-	if (!fs2.is_open()) {
+	MappedFile fs2{};
+	if (!fs2.Open(baseName)) {
 		std::cout << "\nFailed to open " << baseName;
 		std::cout << "\n\nPress any key...";
 		system("pause");
 		return -1;
 	}
-	std::stringstream ss2{};
-	ss2 << fs2.rdbuf();
-	const string targettext = ss2.str();
-	fs2.close();
+	string targettext = fs2.Text();
+	fs2.Close();
 	
 	//logger.Info("\n\nINPUT TARGET: <\n{}\n>"sv, targettext);
 
-	if (!parser.SetTarget(targettext))
+	if (!parser.SetTarget(std::move(targettext)))
 		std::cout << "\nparser.SetTarget() failed!\n";
 	else
 		std::cout << "\nparser.SetTarget() succeeded!\n";
@@ -0,0 +1,106 @@
+#include "logger.h"
+#include "StringParser.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using std::filesystem::path;
+
+
+//Parses every <case>.diff in a directory with <case>.target and compares the result to <case>.out. An .out file holds "OK" or "FAIL" on
+//its first line, then the parsed file if the parse succeeded. Usage: GoldenTest <directory> [update], where update rewrites the .out
+//files from the current parser instead of comparing.
+namespace {
+
+	[[nodiscard]] bool ReadText(const path& file, string& out) {
+		std::ifstream ifs{ file, std::ios::binary };
+		if (!ifs.is_open()) {
+			return false;
+		}
+		std::stringstream ss{};
+		ss << ifs.rdbuf();
+		out = ss.str();
+		return true;
+	}
+
+	[[nodiscard]] string Run(const string& diff, const string& target) {
+		StringParser::Parser parser{};
+		string out{};
+		if (!parser.SetDiff(diff) || !parser.SetTarget(target) || !parser.Parse(out)) {
+			return "FAIL\n";
+		}
+		return "OK\n" + out;
+	}
+
+	//First line where expected and actual differ, counting from 1
+	[[nodiscard]] szt FirstDifference(string_view expected, string_view actual) noexcept {
+		const szt length{ std::min(expected.size(), actual.size()) };
+		szt line{ 1u };
+		for (szt i{ 0u }; i < length && expected[i] == actual[i]; ++i) {
+			line += expected[i] == '\n' ? 1u : 0u;
+		}
+		return line;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cout << "Usage: GoldenTest <directory> [update]\n";
+		return 1;
+	}
+	logger.Init();
+	const path dir{ argv[1] };
+	const bool update{ argc > 2 && string_view{ argv[2] } == "update" };
+	vector<path> cases{};
+	std::error_code ec{};
+	for (const auto& entry : std::filesystem::directory_iterator{ dir, ec }) {
+		if (entry.path().extension() == ".diff") {
+			cases.push_back(entry.path());
+		}
+	}
+	std::sort(cases.begin(), cases.end());
+
+	szt failed{ 0u };
+	for (const auto& diff_path : cases) {
+		path target_path{ diff_path }, out_path{ diff_path };
+		target_path.replace_extension(".target");
+		out_path.replace_extension(".out");
+		const string name{ diff_path.stem().string() };
+		string diff{}, target{}, expected{};
+		if (!ReadText(diff_path, diff) || !ReadText(target_path, target)) {
+			std::cout << "FAIL " << name << ": missing " << target_path.filename().string() << "\n";
+			++failed;
+			continue;
+		}
+		const string actual{ Run(diff, target) };
+		if (update) {
+			std::ofstream ofs{ out_path, std::ios::binary | std::ios::trunc };
+			if (!ofs.write(actual.data(), static_cast<std::streamsize>(actual.size()))) {
+				std::cout << "FAIL " << name << ": couldn't write " << out_path.filename().string() << "\n";
+				++failed;
+			}
+			continue;
+		}
+		if (!ReadText(out_path, expected)) {
+			std::cout << "FAIL " << name << ": missing " << out_path.filename().string() << "\n";
+			++failed;
+		}
+		else if (actual != expected) {
+			std::cout << "FAIL " << name << ": differs from " << out_path.filename().string() << " at line " << FirstDifference(expected, actual) << "\n" << actual;
+			if (!actual.empty() && actual.back() != '\n') {
+				std::cout << "\n";
+			}
+			++failed;
+		}
+		else {
+			std::cout << "ok   " << name << "\n";
+		}
+	}
+	std::cout << cases.size() - failed << " of " << cases.size() << " golden cases " << (update ? "updated" : "passed") << "\n";
+	logger.Close();
+	return failed == 0u && !cases.empty() ? 0 : 1;
+}